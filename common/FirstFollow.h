@@ -0,0 +1,276 @@
+#ifndef FIRST_FOLLOW_H
+#define FIRST_FOLLOW_H
+
+#include <vector>
+#include <cstdint>
+
+// LL1分析(lab3)和SLR1分析(lab5)共用的First/Follow求解
+// 文法符号统一编成稠密的整数: 终结符为0..T-1, 非终结符为T..T+N-1
+// 产生式右部为空表示推出空串, 集合只记录终结符, 是否可推空单独记录
+
+// 终结符集合, 按64位字存放的位集
+struct SymbolSet
+{
+    std::vector<uint64_t> _words;
+
+    SymbolSet(int n = 0) : _words((n + 63) / 64, 0) {}
+
+    inline bool test(int i) const
+    {
+        return (_words[i >> 6] >> (i & 63)) & 1;
+    }
+
+    // 加入元素i, 返回集合是否发生变化
+    inline bool insert(int i)
+    {
+        uint64_t bit = 1ULL << (i & 63);
+        if(_words[i >> 6] & bit)
+            return false;
+        _words[i >> 6] |= bit;
+        return true;
+    }
+
+    // 并入集合s, 返回集合是否发生变化
+    inline bool merge(const SymbolSet& s)
+    {
+        uint64_t changed = 0;
+        for(int i = 0; i < _words.size(); ++i)
+        {
+            uint64_t w = _words[i] | s._words[i];
+            changed |= w ^ _words[i];
+            _words[i] = w;
+        }
+        return changed != 0;
+    }
+
+    inline void clear()
+    {
+        for(auto& w : _words)
+            w = 0;
+    }
+
+    inline bool empty() const
+    {
+        for(auto& w : _words)
+        {
+            if(w)
+                return false;
+        }
+        return true;
+    }
+
+    // 按从小到大的顺序遍历集合中的元素
+    template<typename F>
+    void forEach(F f) const
+    {
+        for(int i = 0; i < _words.size(); ++i)
+        {
+            uint64_t w = _words[i];
+            while(w)
+            {
+                f(i * 64 + __builtin_ctzll(w));
+                w &= w - 1;
+            }
+        }
+    }
+};
+
+// First/Follow不动点引擎
+// 先按产生式建出集合之间的包含关系图, 例如A->BC且B可推空时First(C)⊆First(A), A->aB时Follow(A)⊆Follow(B)
+// 再用工作表传播: 只有某个集合发生变化时才把它重新并入依赖它的集合, 不再整轮扫描所有产生式
+class FirstFollowEngine
+{
+private:
+    int _numTerminals;
+    int _numNonTerminals;
+    std::vector<bool> _nullable;
+    // 下标为符号编号, 终结符的First集合为其本身
+    std::vector<SymbolSet> _first;
+    // 下标为非终结符编号减去_numTerminals
+    std::vector<SymbolSet> _follow;
+
+    inline bool isTerminal(int X) const { return X < _numTerminals; }
+
+    // 可推空的非终结符: 记录每个产生式右部还有几个符号未确定可推空, 减到0时左部可推空
+    void computeNullable(const std::vector<int>& lhs, const std::vector<std::vector<int>>& rhs)
+    {
+        std::vector<int> remain(lhs.size());
+        std::vector<std::vector<int>> occurs(_numNonTerminals);
+        std::vector<int> worklist;
+        for(int p = 0; p < lhs.size(); ++p)
+        {
+            remain[p] = rhs[p].size();
+            for(auto& X : rhs[p])
+            {
+                if(!isTerminal(X))
+                    occurs[X - _numTerminals].push_back(p);
+            }
+            if(remain[p] == 0 && !_nullable[lhs[p]])
+            {
+                _nullable[lhs[p]] = true;
+                worklist.push_back(lhs[p]);
+            }
+        }
+        while(!worklist.empty())
+        {
+            int X = worklist.back();
+            worklist.pop_back();
+            for(auto& p : occurs[X - _numTerminals])
+            {
+                if(--remain[p] == 0 && !_nullable[lhs[p]])
+                {
+                    _nullable[lhs[p]] = true;
+                    worklist.push_back(lhs[p]);
+                }
+            }
+        }
+    }
+
+    // 沿包含关系图传播, sets[i]变化后并入所有edges[i]指向的集合, 直到没有集合变化
+    static void propagate(std::vector<SymbolSet>& sets, const std::vector<std::vector<int>>& edges)
+    {
+        std::vector<int> worklist;
+        std::vector<bool> queued(sets.size(), false);
+        for(int i = 0; i < sets.size(); ++i)
+        {
+            if(!sets[i].empty() && !edges[i].empty())
+            {
+                worklist.push_back(i);
+                queued[i] = true;
+            }
+        }
+        while(!worklist.empty())
+        {
+            int from = worklist.back();
+            worklist.pop_back();
+            queued[from] = false;
+            for(auto& to : edges[from])
+            {
+                if(sets[to].merge(sets[from]) && !queued[to] && !edges[to].empty())
+                {
+                    worklist.push_back(to);
+                    queued[to] = true;
+                }
+            }
+        }
+    }
+
+    // 去掉重复的边, 避免同一个集合被重复并入
+    static void addEdge(std::vector<std::vector<int>>& edges, int from, int to)
+    {
+        if(from == to)
+            return;
+        for(auto& t : edges[from])
+        {
+            if(t == to)
+                return;
+        }
+        edges[from].push_back(to);
+    }
+
+    void computeFirst(const std::vector<int>& lhs, const std::vector<std::vector<int>>& rhs)
+    {
+        for(int X = 0; X < _numTerminals; ++X)
+            _first[X].insert(X);
+        // edges[Y] 包含 A 表示 First(Y)⊆First(A)
+        std::vector<std::vector<int>> edges(_numTerminals + _numNonTerminals);
+        for(int p = 0; p < lhs.size(); ++p)
+        {
+            int A = lhs[p];
+            for(auto& X : rhs[p])
+            {
+                if(isTerminal(X))
+                {
+                    _first[A].insert(X);
+                    break;
+                }
+                addEdge(edges, X, A);
+                if(!_nullable[X])
+                    break;
+            }
+        }
+        propagate(_first, edges);
+    }
+
+    void computeFollow(const std::vector<int>& lhs, const std::vector<std::vector<int>>& rhs,
+                       int startSymbol, int endMarker)
+    {
+        // edges[A] 包含 B 表示 Follow(A)⊆Follow(B), 下标都减去了_numTerminals
+        std::vector<std::vector<int>> edges(_numNonTerminals);
+        _follow[startSymbol - _numTerminals].insert(endMarker);
+        for(int p = 0; p < lhs.size(); ++p)
+        {
+            // 从右往左扫描, trail为当前符号之后的后缀的First集合
+            SymbolSet trail(_numTerminals);
+            bool trailNullable = true;
+            for(int i = (int)rhs[p].size() - 1; i >= 0; --i)
+            {
+                int X = rhs[p][i];
+                if(isTerminal(X))
+                {
+                    trail.clear();
+                    trail.insert(X);
+                    trailNullable = false;
+                    continue;
+                }
+                _follow[X - _numTerminals].merge(trail);
+                if(trailNullable)
+                    addEdge(edges, lhs[p] - _numTerminals, X - _numTerminals);
+                if(_nullable[X])
+                    trail.merge(_first[X]);
+                else
+                {
+                    trail = _first[X];
+                    trailNullable = false;
+                }
+            }
+        }
+        propagate(_follow, edges);
+    }
+
+public:
+    FirstFollowEngine() : _numTerminals(0), _numNonTerminals(0) {}
+
+    FirstFollowEngine(int numTerminals, int numNonTerminals,
+                      const std::vector<int>& lhs, const std::vector<std::vector<int>>& rhs,
+                      int startSymbol, int endMarker)
+    {
+        compute(numTerminals, numNonTerminals, lhs, rhs, startSymbol, endMarker);
+    }
+
+    // lhs[p]为第p条产生式的左部, rhs[p]为右部(空表示推出空串), 都使用稠密编号
+    // endMarker为结束符号对应的终结符编号, 加入开始符号的Follow集合
+    void compute(int numTerminals, int numNonTerminals,
+                 const std::vector<int>& lhs, const std::vector<std::vector<int>>& rhs,
+                 int startSymbol, int endMarker)
+    {
+        _numTerminals = numTerminals;
+        _numNonTerminals = numNonTerminals;
+        _nullable.assign(numTerminals + numNonTerminals, false);
+        _first.assign(numTerminals + numNonTerminals, SymbolSet(numTerminals));
+        _follow.assign(numNonTerminals, SymbolSet(numTerminals));
+        computeNullable(lhs, rhs);
+        computeFirst(lhs, rhs);
+        computeFollow(lhs, rhs, startSymbol, endMarker);
+    }
+
+    inline int numTerminals() const { return _numTerminals; }
+    inline int numNonTerminals() const { return _numNonTerminals; }
+    inline bool nullable(int X) const { return _nullable[X]; }
+    inline const SymbolSet& first(int X) const { return _first[X]; }
+    inline const SymbolSet& follow(int A) const { return _follow[A - _numTerminals]; }
+
+    // 求符号串[begin, end)的First集合并入out, 返回该符号串是否可以推出空串
+    bool stringFirst(const int* begin, const int* end, SymbolSet& out) const
+    {
+        for(const int* it = begin; it != end; ++it)
+        {
+            out.merge(_first[*it]);
+            if(!_nullable[*it])
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
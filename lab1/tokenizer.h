@@ -0,0 +1,363 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <deque>
+#include <algorithm>
+
+// 词法分析器, lab1直接输出单词序列, lab3的LL1分析器从这里逐个拉取单词
+// 源程序按块从输入流读入, 缓冲区只保留当前单词之后尚未分析的部分, 分析大文件时内存占用不随文件增长
+
+const int _EOF_ = -2;
+const int _ERROR_ = -1;
+enum {
+    _ID_, _INT_, _DOUBLE_, _OPERATOR_, _DELIMITER_, _KEYWORD_, _CHAR_, _STRING_, _COMMENT_, _SPACE_
+};  // 类型
+static const std::string cat[10] = { "id", "int", "double", "operator", "delimiter", "keyword", "char", "string", "comment", "space" };
+static const std::string op = "+-*/%=!&|<>";
+
+std::vector<std::string> FileRead(const std::string &filepath)
+{
+    std::vector<std::string> ret;
+    std::fstream fin(filepath, std::ios::in);
+    if(!fin.is_open())
+    {
+        std::cerr << "Error: open file failed!" << std::endl;
+        exit(-1);
+    }
+    std::string line;
+    while(getline(fin, line))
+        ret.push_back(line);
+    return ret;
+}
+
+const int KEYWORD_NUM = 22;
+const int OPERATOR_NUM = 28;
+const int DELIMITER_NUM = 13;
+// 关键字、运算符、界符的种别码是它们在catagory.txt中的行号, 其余几类单词各用一个固定的种别码
+const int COMMENT_CODE = 64;
+const int ID_CODE = 65;
+const int INT_CODE = 66;
+const int DOUBLE_CODE = 67;
+const int CODE_NUM = 68;
+
+struct token{
+    int _type;
+    std::string _catagory; // 类别
+    std::string _value;    // 值
+    token(): _type(_EOF_) {}
+    token(int type, const std::string &val, const std::string &cat)
+        :_type(type), _catagory(cat), _value(val){}
+    friend std::ostream& operator << (std::ostream& os, const token& t)
+    {
+        return os << t._catagory
+                << ", type:" << t._type << ", "
+                << t._value << std::endl;
+    }
+};
+
+
+class Tokenizer{
+private:
+    // 每次从输入流读入的字节数
+    static const size_t CHUNK_SIZE = 1 << 16;
+
+    std::ifstream _file;
+    std::istream* _in;
+    std::string _src;       // 尚未分析完的源程序片段, _pos是当前字符在其中的下标
+    size_t _pos;
+    int _line;
+    std::vector<token> _tokenList;
+    std::deque<token> _pending;     // 已识别但还没有被取走的单词, 注释一次产生三个单词
+    std::string _curToken;
+    std::vector<std::string> _spelling;     // 种别码到关键字/运算符/界符的拼写
+    std::unordered_map<std::string, int> _catagoryCodeTable;
+    std::string _delimiterChars;
+private:
+    // 丢掉已经分析过的前缀, 再从输入流读入一块追加到缓冲区末尾, 没有更多输入时返回false
+    bool fill()
+    {
+        if(!_in || !_in->good())
+            return false;
+        size_t consumed = std::min(_pos, _src.size());
+        _src.erase(0, consumed);
+        _pos -= consumed;
+        size_t old = _src.size();
+        _src.resize(old + CHUNK_SIZE);
+        _in->read(&_src[old], CHUNK_SIZE);
+        _src.resize(old + _in->gcount());
+        return _src.size() > old;
+    }
+    char peek()
+    {
+        if(_pos + 1 >= _src.size())
+            fill();
+        if(_pos + 1 < _src.size())
+            return _src[_pos + 1];
+        return '\0';
+    }
+    inline bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+    // 是否为字母或下划线
+    inline bool isLetter(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+    inline bool isKeyword(const std::string &s) {
+        auto it = _catagoryCodeTable.find(s);
+        return it != _catagoryCodeTable.end() && it->second < KEYWORD_NUM;
+    }
+    inline bool isOP(char ch) {
+        return op.find(ch) != std::string::npos;
+    }
+    inline bool isOperator(const std::string& s) {
+        auto it = _catagoryCodeTable.find(s);
+        return it != _catagoryCodeTable.end() && it->second >= KEYWORD_NUM && it->second < KEYWORD_NUM + OPERATOR_NUM;
+    }
+    inline bool isDelimiter(char ch) {
+        return _delimiterChars.find(ch) != std::string::npos;
+    }
+
+    int judge(char ch)
+    {
+        if(ch == '\n') ++_line;
+        if(ch == '\n' || ch == ' ' || ch == '\t' || ch == '\r') return _SPACE_;
+        if(isDigit(ch)) {
+            char nextChar = peek();
+            if(ch == '0' && nextChar == '.') { // 0.多少
+                ++_pos;
+                if(!isDigit(peek()))   // .后面不是数字
+                    return _ERROR_;
+                _curToken = "0.";
+                while(isDigit(peek())) {
+                    _curToken += peek();
+                    ++_pos;
+                }
+                return _DOUBLE_;    // 8
+            }  else if(ch == '0' && isLetter(nextChar)) {  // digit1
+                return _ERROR_;
+            }else if(ch == '0' && !isDigit(nextChar))
+            { // 不是数字也不是.，说明是单纯的一个0
+                _curToken = "0";
+                return _INT_;   // 5
+            }else if(ch != '0') {  // digit1
+                _curToken = ch;
+                while(isDigit(peek())) {
+                    _curToken += peek();
+                    ++_pos;
+                }
+                char nextChar = peek();
+                if(nextChar == '.') {
+                    _curToken += nextChar;
+                    ++_pos;
+                    nextChar = peek();
+                    if(isDigit(nextChar)) {
+                        _curToken += peek();
+                        ++_pos;
+                        while(isDigit(peek())) {
+                            _curToken += peek();
+                            ++_pos;
+                        }
+                        return _DOUBLE_;    // 8
+                    } else return _ERROR_;
+                } else return _INT_;    // 6
+            } else {    // 0+数字
+                ++_pos;
+                return _ERROR_;         // ERROR
+            }
+        }
+        if(isLetter(ch)) {
+            _curToken = ch;
+            char nextChar = peek();
+            while( isLetter(nextChar) || isDigit(nextChar) ) { // 标识符~
+                _curToken += nextChar;
+                ++_pos;
+                nextChar = peek();
+            }
+            return isKeyword(_curToken) ? _KEYWORD_ : _ID_;
+        }
+        // 只有/*开始注释, 单独的/是除号, 交给下面的运算符处理
+        if(ch == '/' && peek() == '*') {
+            ++_pos;
+            char nextChar = peek();
+            ++_pos;
+            _curToken = "";
+            while(_pos < _src.size()) {
+                if(nextChar == '*' && peek() == '/') {
+                    _pending.push_back(token(_catagoryCodeTable["/*"], "/*", cat[_DELIMITER_]));
+                    _pending.push_back(token(COMMENT_CODE, _curToken, cat[_COMMENT_]));
+                    _pending.push_back(token(_catagoryCodeTable["*/"], "*/", cat[_DELIMITER_]));
+                    ++_pos;     // 停在*/的/上, 和其他单词一样由next跳过最后一个字符
+                    return _COMMENT_;
+                } else {
+                    if(nextChar == '\n') ++_line;
+                    _curToken += nextChar;
+                    nextChar = peek();
+                    ++_pos;
+                }
+            }
+            return _ERROR_;     // 注释没有结束
+        }
+
+        if(isOP(ch)) {   // op运算符
+            _curToken = "";
+            _curToken += ch;
+            char nextChar = peek();
+            if(isOP(nextChar)) {
+                if(isOperator(_curToken + nextChar)) {
+                    _curToken += nextChar;
+                    ++_pos;
+                    return _OPERATOR_;      // 15
+                } else return _OPERATOR_;   // 14
+            } else return _OPERATOR_;       // 14
+        }
+        if(isDelimiter(ch)) {
+            _curToken = "";
+            _curToken += ch;
+            return _DELIMITER_;
+        }
+        return _ERROR_;
+    }
+
+    int next()
+    {
+        // 处理空格和换行
+        if(_pos >= _src.size() && !fill())
+            return _EOF_;
+        int type = judge(_src[_pos]);
+        while(type == _SPACE_) {
+            ++_pos;
+            // 位于本文末尾 EOF
+            if(_pos >= _src.size() && !fill())
+                return _EOF_;
+            type = judge(_src[_pos]);
+        }
+        ++_pos;
+
+        if(type == _ERROR_) return _ERROR_;
+        if(type == _DOUBLE_) {
+            _pending.push_back(token(DOUBLE_CODE, _curToken, cat[_DOUBLE_]));
+            return _DOUBLE_;
+        }
+        if(type == _INT_) {
+            _pending.push_back(token(INT_CODE, _curToken, cat[_INT_]));
+            return _INT_;
+        }
+        if(type == _ID_) {  // 标识符
+            _pending.push_back(token(ID_CODE, _curToken, cat[_ID_]));
+            return _ID_;
+        }
+        if(type == _OPERATOR_ || type == _KEYWORD_ || type == _DELIMITER_) {
+            _pending.push_back(token(_catagoryCodeTable[_curToken], _curToken, cat[type]));
+            return type;
+        }
+        if(type == _COMMENT_) {
+            return _COMMENT_;
+        }
+        return _ERROR_;
+    }
+
+    void reset(std::istream* in)
+    {
+        _in = in;
+        _src.clear();
+        _pos = 0;
+        _line = 1;
+        _tokenList.clear();
+        _pending.clear();
+    }
+
+public:
+    explicit Tokenizer(const std::string& catagoryPath = "./catagory.txt")
+        : _in(nullptr), _src(), _pos(0), _line(1), _tokenList()
+    {
+        auto catagory = FileRead(catagoryPath);
+        if(catagory.size() < KEYWORD_NUM + OPERATOR_NUM + DELIMITER_NUM)
+        {
+            std::cerr << "Error: " << catagoryPath << " is incomplete!" << std::endl;
+            exit(-1);
+        }
+        _spelling.assign(catagory.begin(), catagory.begin() + KEYWORD_NUM + OPERATOR_NUM + DELIMITER_NUM);
+        for(int i = 0; i < _spelling.size(); ++i)
+            _catagoryCodeTable[_spelling[i]] = i;
+        for(int i = KEYWORD_NUM + OPERATOR_NUM; i < _spelling.size(); ++i)
+            _delimiterChars += _spelling[i][0];
+    }
+    Tokenizer(const std::string &src, int, int) = delete;
+    Tokenizer(const Tokenizer&) = delete;
+    ~Tokenizer() {}
+
+    // 打开源文件, 之后用nextToken逐个取单词或者用Tokenize一次分析完
+    void loadSrcCode(const std::string& filepath)
+    {
+        if(_file.is_open())
+            _file.close();
+        _file.clear();
+        _file.open(filepath, std::ios::in | std::ios::binary);
+        if(!_file.is_open())
+        {
+            std::cerr << "Error: open file failed!" << std::endl;
+            exit(-1);
+        }
+        reset(&_file);
+    }
+    // 从任意输入流读源程序, 流由调用者持有
+    void loadSrcCode(std::istream& in)
+    {
+        reset(&in);
+    }
+
+    // 取下一个单词, 返回它的种别码, 文件结束返回_EOF_, 出错返回_ERROR_并在t中给出出错行号
+    // t由调用者反复使用, 单词的值直接移动到t中
+    int nextToken(token& t)
+    {
+        if(_pending.empty())
+        {
+            int flag = next();
+            if(flag == _EOF_)
+            {
+                t._type = _EOF_;
+                t._catagory = "EOF";
+                t._value.clear();
+                return _EOF_;
+            }
+            if(flag == _ERROR_)
+                _pending.push_back(token(_ERROR_, "FIND ERROR in line " + std::to_string(_line), "ERROR"));
+        }
+        t = std::move(_pending.front());
+        _pending.pop_front();
+        return t._type;
+    }
+
+    void Tokenize()
+    {
+        token t;
+        while(nextToken(t) != _EOF_)
+            _tokenList.push_back(t);
+        std::cout << "Tokenize finished!" << std::endl;
+    }
+
+    std::vector<token> getTokenList()
+    {
+        return _tokenList;
+    }
+
+    // 当前分析到的行号
+    int line() const
+    {
+        return _line;
+    }
+
+    // 关键字、运算符、界符的种别码对应的拼写, 其余种别码返回空串
+    const std::string& spelling(int code) const
+    {
+        static const std::string none;
+        return code >= 0 && code < _spelling.size() ? _spelling[code] : none;
+    }
+};
+
+#endif
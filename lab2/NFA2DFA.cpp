@@ -5,11 +5,18 @@
 #include <set>
 #include <map>
 #include <stack>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 // 右线性文法转化NFA
 // NFA确定为DFA
 
-const int N = 1024;
-
 // 规则A->&， &表示空串
 struct productionRule
 {
@@ -88,9 +95,11 @@ std::vector<std::string> FileRead(const std::string &filepath)
 }
 
 
-void init()
+// 读取文法文件, 多DFA匹配时需要同时加载多个文法, 因此不直接写全局的grammar
+Grammar loadGrammar(const std::string& filepath)
 {
-    auto lines = FileRead(ruleFilePath);
+    Grammar g;
+    auto lines = FileRead(filepath);
     int flag = 0;
     for(auto& line : lines)
     {
@@ -99,33 +108,40 @@ void init()
         {
             if(!flag)
             {
-                grammar._startSymbol = line[0];
+                g._startSymbol = line[0];
                 for(auto& c : line)
-                    grammar._nonTerminalSymbols.push_back(c);
+                    g._nonTerminalSymbols.push_back(c);
                 flag = 1;
             }
             else
             {
                 for(auto& c : line)
-                        grammar._terminalSymbols.push_back(c);
+                        g._terminalSymbols.push_back(c);
             }
         }
         else
         {
             char lhs = line[0];
             std::string rhs = line.substr(pos + 2);
-            grammar._productionRules.push_back({lhs, rhs});
+            g._productionRules.push_back({lhs, rhs});
         }
     }
     // 结束符号 # 当作终结符加入到终结符集合中
-    grammar._terminalSymbols.push_back('#');
+    g._terminalSymbols.push_back('#');
+    return g;
+}
+
+void init()
+{
+    grammar = loadGrammar(ruleFilePath);
     std::cout << grammar;
 }
 
 struct NFA
 {
-    // 状态图邻接矩阵
-    std::vector<std::vector<char>> _stateGraph;
+    // 状态图邻接表, _edges[i]是状态i的出边(字符, 目标状态下标)
+    // 同一对状态之间可以有多个字符的转移, 例如Z->0Z和Z->1Z
+    std::vector<std::vector<std::pair<char, int>>> _edges;
     // 字母表
     std::vector<char> _alaphabet;
     // 状态集合
@@ -145,45 +161,45 @@ struct NFA
         return -1;
     }
 
+    void addEdge(int i, char a, int j)
+    {
+        for(auto& e : _edges[i])
+        {
+            if(e.first == a && e.second == j)
+                return;
+        }
+        _edges[i].push_back({a, j});
+    }
+
     void constructNFA(const Grammar& g)
     {
         for(auto& p : g._productionRules)
         {
+            int i = g.getIndexOfNonTerminal(p._lhs);
+            int j = -1;
             if(p._rhs.size() == 1)
-            {
-                if(p._rhs[0] == '&')
-                {
-                    int i = g.getIndexOfNonTerminal(p._lhs);
-                    int j = _states.size() - 1;
-                    _stateGraph[i][j] = '&';
-                }
-                else
-                {
-                    int i = grammar.getIndexOfNonTerminal(p._lhs);
-                    int j = _states.size() - 1;
-                    _stateGraph[i][j] = p._rhs[0];
-                }
-            }
+                j = _states.size() - 1;
             else if(p._rhs.size() == 2)
-            {
-                int i = grammar.getIndexOfNonTerminal(p._lhs);
-                int j = grammar.getIndexOfNonTerminal(p._rhs[1]);
-                _stateGraph[i][j] = p._rhs[0];
-            }
+                j = g.getIndexOfNonTerminal(p._rhs[1]);
             else
             {
 
                 std::cerr << "Error: 产生式右部" << p << "不符合右线性文法!" << std::endl;
                 exit(-1);
             }
+            if(i < 0 || j < 0)
+            {
+                std::cerr << "Error: 产生式" << p << "中有未声明的非终结符!" << std::endl;
+                exit(-1);
+            }
+            // A->a和A->&都转移到终结状态, A->aB转移到B
+            addEdge(i, p._rhs[0], j);
         }
     }
     NFA() = delete;
     NFA(const Grammar& g)
     {
-        _stateGraph.resize(g._nonTerminalSymbols.size() + 1);
-        for(auto& v : _stateGraph)
-            v.resize(g._nonTerminalSymbols.size() + 1, '\0');
+        _edges.resize(g._nonTerminalSymbols.size() + 1);
         for(auto& ch : g._terminalSymbols)
             _alaphabet.push_back(ch);
         for(auto& ch : g._nonTerminalSymbols)
@@ -202,8 +218,11 @@ struct NFA
         {
             for(int j = 0; j < _states.size(); ++j)
             {
-                if(_stateGraph[i][j] != '\0')
-                    std::cout << _states[i] << "--" << _stateGraph[i][j] << "-->" << _states[j] << std::endl;
+                for(auto& e : _edges[i])
+                {
+                    if(e.second == j)
+                        std::cout << _states[i] << "--" << e.first << "-->" << _states[j] << std::endl;
+                }
             }
         }
     }
@@ -213,8 +232,9 @@ struct NFA
 // 参考龙书上的子集构造算法实现的NFA转DFA，教材上的写的不好
 struct DFA
 {
-    // 状态图邻接矩阵
-    std::vector<std::vector<char>> _stateGraph;
+    // 转移表, _transTable[状态][字母表下标] = 目标状态, -1表示无转移
+    // 两个字符转移到同一状态时各占一项, 不会互相覆盖
+    std::vector<std::vector<int>> _transTable;
     // 字母表
     std::vector<char> _alaphabet;
     // NFA状态集合和DFA状态的映射表
@@ -249,15 +269,12 @@ struct DFA
         {
             char top = st.top();
             st.pop();
-            for(int i = 0; i < nfa._states.size(); ++i)
+            for(auto& e : nfa._edges[nfa.getIndexOfState(top)])
             {
-                if(nfa._stateGraph[nfa.getIndexOfState(top)][i] == '&')
+                if(e.first == '&' && ret.find(nfa._states[e.second]) == ret.end())
                 {
-                    if(ret.find(nfa._states[i]) == ret.end())
-                    {
-                        ret.insert(nfa._states[i]);
-                        st.push(nfa._states[i]);
-                    }
+                    ret.insert(nfa._states[e.second]);
+                    st.push(nfa._states[e.second]);
                 }
             }
         }
@@ -270,10 +287,10 @@ struct DFA
         std::set<char> ret;
         for(auto& u : T)
         {
-            for(int i = 0; i < nfa._states.size(); ++i)
+            for(auto& e : nfa._edges[nfa.getIndexOfState(u)])
             {
-                if(nfa._stateGraph[nfa.getIndexOfState(u)][i] == a)
-                    ret.insert(nfa._states[i]);
+                if(e.first == a)
+                    ret.insert(nfa._states[e.second]);
             }
         }
         return ret;
@@ -281,16 +298,17 @@ struct DFA
 
     DFA(const NFA& nfa) : _alaphabet(nfa._alaphabet), _startState(0)
     {
-        _stateGraph.resize(N, std::vector<char>(N, '\0'));
         auto startEpsilonClosure = epsilonClosure({nfa._startState}, nfa);
         _DstatesList.push_back(startEpsilonClosure);
+        _transTable.push_back(std::vector<int>(_alaphabet.size(), -1));
         _Dstates[startEpsilonClosure] = {0, false};
         while(!getUnmarkedState().empty())
         {
             auto T = getUnmarkedState();
             _Dstates[T].second = true;
-            for(const auto& a : _alaphabet)
+            for(int k = 0; k < _alaphabet.size(); ++k)
             {
+                char a = _alaphabet[k];
                 auto moveSet = move(T, a, nfa);
                 if(!moveSet.empty())
                 {
@@ -299,8 +317,9 @@ struct DFA
                     {
                         _Dstates[U] = {_Dstates.size(), false};
                         _DstatesList.push_back(U);
+                        _transTable.push_back(std::vector<int>(_alaphabet.size(), -1));
                     }
-                    _stateGraph[_Dstates[T].first][_Dstates[U].first] = a;
+                    _transTable[_Dstates[T].first][k] = _Dstates[U].first;
                 }
             }
         }
@@ -324,8 +343,11 @@ struct DFA
         {
             for(int j = 0; j < _DstatesList.size(); ++j)
             {
-                if(_stateGraph[i][j] != '\0')
-                    std::cout << i << "--" << _stateGraph[i][j] << "-->" << j << std::endl;
+                for(int k = 0; k < _alaphabet.size(); ++k)
+                {
+                    if(_transTable[i][k] == j)
+                        std::cout << i << "--" << _alaphabet[k] << "-->" << j << std::endl;
+                }
             }
         }
         // 打印DFA的状态集合
@@ -347,13 +369,576 @@ struct DFA
     }
 };
 
-int main(int argc, char* argv[])
+// 编译后DFA文件的格式版本, 修改文件布局时需要递增
+const uint32_t COMPILED_DFA_VERSION = 2;
+
+// 编译后DFA文件头, 之后依次是256字节的字符类映射、int32转移表、uint64接受状态位图
+// 各段都按自身类型对齐, 加载时直接把mmap得到的地址当作数组使用
+struct CompiledDFAHeader
 {
-    if(argc != 2)
+    char _magic[4];            // "CDFA"
+    uint32_t _version;
+    uint64_t _grammarHash;     // 源文法文件内容的哈希, 文法变化后缓存自动失效
+    uint64_t _grammarSize;     // 源文法文件的大小和修改时间(纳秒), 都相同时不再读文法文件求哈希
+    int64_t _grammarMtime;
+    uint32_t _numStates;
+    uint32_t _numClasses;
+    uint32_t _startState;
+    uint32_t _flags;           // 第0位表示已最小化
+};
+
+const uint32_t COMPILED_DFA_MINIMIZED = 1;
+
+// 编译后DFA对应的文法文件: 内容哈希, 以及写缓存时文件的大小和修改时间
+struct GrammarStamp
+{
+    uint64_t _hash;
+    uint64_t _size;
+    int64_t _mtime;
+};
+
+// FNV-1a 64位哈希
+uint64_t hashBytes(const std::string& data)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for(auto& c : data)
+    {
+        h ^= (unsigned char)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// 只读映射的文件, 析构时解除映射
+struct MappedFile
+{
+    void* _addr;
+    size_t _size;
+    MappedFile(void* addr, size_t size) : _addr(addr), _size(size) {}
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile() { munmap(_addr, _size); }
+};
+
+// 编译后的DFA, 用于实际匹配输入串
+// 字符先经过字符类映射, 再查稠密转移表, 状态0固定为死状态, 原DFA的状态i对应编译后的状态i+1
+// 字符类0表示不在字母表中的字符, 任何状态经过它都转移到死状态
+// 表既可以由DFA编译得到(存放在自有的vector中), 也可以直接指向mmap加载的文件
+struct CompiledDFA
+{
+    int _numStates;
+    int _numClasses;
+    int _startState;
+    uint32_t _flags;
+    // 256项, 字符 -> 字符类
+    const uint8_t* _classMap;
+    // 行优先的转移表, _trans[状态 * _numClasses + 字符类]
+    const int32_t* _trans;
+    // 接受状态位图
+    const uint64_t* _acceptBits;
+
+    std::vector<uint8_t> _ownedClassMap;
+    std::vector<int32_t> _ownedTrans;
+    std::vector<uint64_t> _ownedAcceptBits;
+    std::shared_ptr<MappedFile> _mapping;
+
+    CompiledDFA() : _numStates(0), _numClasses(0), _startState(0), _flags(0),
+        _classMap(nullptr), _trans(nullptr), _acceptBits(nullptr) {}
+    CompiledDFA(const CompiledDFA&) = delete;
+    CompiledDFA& operator=(const CompiledDFA&) = delete;
+
+    CompiledDFA(const DFA& dfa)
+        : _numStates(dfa._DstatesList.size() + 1), _numClasses(dfa._alaphabet.size() + 1),
+          _startState(dfa._startState + 1), _flags(0)
+    {
+        // 字符类0留给不在字母表中的字符, 字符类映射每项一个字节, 字母表最多255个字符
+        if(_numClasses > 256)
+        {
+            std::cerr << "Error: 字母表有" << dfa._alaphabet.size() << "个字符, 编译后的DFA最多支持255个!" << std::endl;
+            exit(-1);
+        }
+        _ownedClassMap.assign(256, 0);
+        for(int k = 0; k < dfa._alaphabet.size(); ++k)
+            _ownedClassMap[(unsigned char)dfa._alaphabet[k]] = k + 1;
+        _ownedTrans.assign(_numStates * _numClasses, 0);
+        for(int i = 0; i < dfa._transTable.size(); ++i)
+        {
+            for(int k = 0; k < dfa._transTable[i].size(); ++k)
+            {
+                if(dfa._transTable[i][k] != -1)
+                    _ownedTrans[(i + 1) * _numClasses + k + 1] = dfa._transTable[i][k] + 1;
+            }
+        }
+        _ownedAcceptBits.assign((_numStates + 63) / 64, 0);
+        for(auto& s : dfa._acceptStates)
+            _ownedAcceptBits[(s + 1) / 64] |= 1ULL << ((s + 1) % 64);
+        bindOwned();
+    }
+
+    void bindOwned()
+    {
+        _classMap = _ownedClassMap.data();
+        _trans = _ownedTrans.data();
+        _acceptBits = _ownedAcceptBits.data();
+        _mapping.reset();
+    }
+
+    inline int classOf(unsigned char c) const { return _classMap[c]; }
+    inline int next(int s, int cls) const { return _trans[s * _numClasses + cls]; }
+    inline bool isAccept(int s) const { return (_acceptBits[s / 64] >> (s % 64)) & 1; }
+
+    bool match(const std::string& str) const
+    {
+        int s = _startState;
+        for(auto& c : str)
+            s = next(s, classOf(c));
+        return isAccept(s);
+    }
+
+    // Moore划分细化法最小化, 初始划分为接受/非接受状态, 反复按后继所在的块细分直到块数不变
+    void minimize()
     {
+        std::vector<int> block(_numStates);
+        for(int s = 0; s < _numStates; ++s)
+            block[s] = isAccept(s) ? 1 : 0;
+        int blockCount = 0;
+        while(true)
+        {
+            std::map<std::vector<int>, int> signatures;
+            std::vector<int> newBlock(_numStates);
+            for(int s = 0; s < _numStates; ++s)
+            {
+                std::vector<int> sig(_numClasses + 1);
+                sig[0] = block[s];
+                for(int c = 0; c < _numClasses; ++c)
+                    sig[c + 1] = block[next(s, c)];
+                auto it = signatures.find(sig);
+                if(it == signatures.end())
+                    it = signatures.insert({sig, (int)signatures.size()}).first;
+                newBlock[s] = it->second;
+            }
+            block.swap(newBlock);
+            if(signatures.size() == blockCount)
+                break;
+            blockCount = signatures.size();
+        }
+        // 重新编号, 保证死状态所在的块仍是状态0
+        std::vector<int> id(blockCount, -1);
+        id[block[0]] = 0;
+        int count = 1;
+        for(int s = 0; s < _numStates; ++s)
+        {
+            if(id[block[s]] == -1)
+                id[block[s]] = count++;
+        }
+        std::vector<int32_t> trans(count * _numClasses, 0);
+        std::vector<uint64_t> accept((count + 63) / 64, 0);
+        for(int s = 0; s < _numStates; ++s)
+        {
+            int t = id[block[s]];
+            for(int c = 0; c < _numClasses; ++c)
+                trans[t * _numClasses + c] = id[block[next(s, c)]];
+            if(isAccept(s))
+                accept[t / 64] |= 1ULL << (t % 64);
+        }
+        _ownedClassMap.assign(_classMap, _classMap + 256);
+        _ownedTrans.swap(trans);
+        _ownedAcceptBits.swap(accept);
+        _startState = id[block[_startState]];
+        _numStates = count;
+        _flags |= COMPILED_DFA_MINIMIZED;
+        bindOwned();
+    }
+
+    static size_t transOffset() { return sizeof(CompiledDFAHeader) + 256; }
+    static size_t acceptOffset(size_t numStates, size_t numClasses) { return (transOffset() + sizeof(int32_t) * numStates * numClasses + 7) / 8 * 8; }
+    static size_t fileSize(size_t numStates, size_t numClasses) { return acceptOffset(numStates, numClasses) + sizeof(uint64_t) * ((numStates + 63) / 64); }
+    size_t acceptOffset() const { return acceptOffset(_numStates, _numClasses); }
+    size_t fileSize() const { return fileSize(_numStates, _numClasses); }
+
+    // 检查表中的字符类和转移目标都在范围内; 只在写缓存时检查一次, 加载时信任自己写出的文件, 不逐页读转移表
+    bool valid() const
+    {
+        if(_numStates <= 0 || _numClasses <= 0 || _numClasses > 256 || _startState < 0 || _startState >= _numStates)
+            return false;
+        for(int c = 0; c < 256; ++c)
+        {
+            if(_classMap[c] >= _numClasses)
+                return false;
+        }
+        for(size_t i = 0; i < (size_t)_numStates * _numClasses; ++i)
+        {
+            if(_trans[i] < 0 || _trans[i] >= _numStates)
+                return false;
+        }
+        return true;
+    }
+
+    // 写入编译后的DFA文件, 先写临时文件再改名, 避免其他进程映射到写了一半的文件
+    // 临时文件名由mkstemp生成, 多个进程同时写同一个缓存时互不干扰, 最后一次改名的结果生效
+    bool save(const std::string& filepath, const GrammarStamp& stamp) const
+    {
+        if(!valid())
+            return false;
+        std::string image(fileSize(), '\0');
+        CompiledDFAHeader header;
+        memcpy(header._magic, "CDFA", 4);
+        header._version = COMPILED_DFA_VERSION;
+        header._grammarHash = stamp._hash;
+        header._grammarSize = stamp._size;
+        header._grammarMtime = stamp._mtime;
+        header._numStates = _numStates;
+        header._numClasses = _numClasses;
+        header._startState = _startState;
+        header._flags = _flags;
+        memcpy(&image[0], &header, sizeof(header));
+        memcpy(&image[sizeof(header)], _classMap, 256);
+        memcpy(&image[transOffset()], _trans, sizeof(int32_t) * _numStates * _numClasses);
+        memcpy(&image[acceptOffset()], _acceptBits, sizeof(uint64_t) * ((_numStates + 63) / 64));
+        std::string tmpPath = filepath + ".XXXXXX";
+        int fd = mkstemp(&tmpPath[0]);
+        if(fd < 0)
+            return false;
+        fchmod(fd, 0644);
+        size_t written = 0;
+        while(written < image.size())
+        {
+            ssize_t n = write(fd, image.data() + written, image.size() - written);
+            if(n <= 0)
+                break;
+            written += n;
+        }
+        bool ok = close(fd) == 0 && written == image.size();
+        if(!ok || rename(tmpPath.c_str(), filepath.c_str()) != 0)
+        {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // mmap加载编译后的DFA文件, 表直接指向映射区域, 加载时只读文件头和256字节的字符类映射, 转移表按需缺页
+    // matchContent为false时按文法文件的大小和修改时间判断缓存是否有效, 为true时按内容哈希判断
+    // 文件不存在、版本或文法不符、标志不符、大小与文件头不符时返回false, 由调用者当作缓存未命中重新构造
+    // 转移目标在写缓存时已经检查过; 加载失败时不修改当前对象
+    bool load(const std::string& filepath, uint32_t flags, const GrammarStamp& stamp, bool matchContent)
+    {
+        int fd = open(filepath.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size < sizeof(CompiledDFAHeader) + 256)
+        {
+            close(fd);
+            return false;
+        }
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(addr == MAP_FAILED)
+            return false;
+        auto mapping = std::make_shared<MappedFile>(addr, st.st_size);
+        const CompiledDFAHeader* header = (const CompiledDFAHeader*)addr;
+        if(memcmp(header->_magic, "CDFA", 4) != 0 || header->_version != COMPILED_DFA_VERSION || header->_flags != flags)
+            return false;
+        if(matchContent ? header->_grammarHash != stamp._hash
+                        : header->_grammarSize != stamp._size || header->_grammarMtime != stamp._mtime)
+            return false;
+        // 字符类最多256个, 状态数限制在int32范围内, 保证下面按文件头算大小时不溢出
+        const uint32_t numStates = header->_numStates, numClasses = header->_numClasses;
+        if(numStates == 0 || numStates > INT32_MAX / 256 || numClasses == 0 || numClasses > 256
+            || header->_startState >= numStates || fileSize(numStates, numClasses) != (size_t)st.st_size)
+            return false;
+        const char* base = (const char*)addr;
+        const uint8_t* classMap = (const uint8_t*)(base + sizeof(CompiledDFAHeader));
+        for(int c = 0; c < 256; ++c)
+        {
+            if(classMap[c] >= numClasses)
+                return false;
+        }
+        _numStates = numStates;
+        _numClasses = numClasses;
+        _startState = header->_startState;
+        _flags = header->_flags;
+        _classMap = classMap;
+        _trans = (const int32_t*)(base + transOffset());
+        _acceptBits = (const uint64_t*)(base + acceptOffset());
+        _ownedClassMap.clear();
+        _ownedTrans.clear();
+        _ownedAcceptBits.clear();
+        _mapping = mapping;
+        return true;
+    }
+};
+
+// 按文法文件加载编译后的DFA, 缓存文件为<ruleFilePath>.cdfa, 最小化的DFA为<ruleFilePath>.min.cdfa
+// 文法文件的大小和修改时间与缓存中记录的相同时直接使用缓存, 不读文法文件; 不同时再按内容哈希比较,
+// 内容没变(例如只是touch过)时继续使用缓存并更新记录的修改时间, 内容变了才重新构造NFA和DFA并覆盖缓存
+void loadCompiledDFA(const std::string& ruleFilePath, bool minimized, CompiledDFA& out)
+{
+    struct stat st;
+    if(stat(ruleFilePath.c_str(), &st) != 0)
+    {
+        std::cerr << "Error: open file failed!" << std::endl;
+        exit(-1);
+    }
+    GrammarStamp stamp = {0, (uint64_t)st.st_size, (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec};
+    std::string cachePath = ruleFilePath + (minimized ? ".min.cdfa" : ".cdfa");
+    uint32_t flags = minimized ? COMPILED_DFA_MINIMIZED : 0;
+    if(out.load(cachePath, flags, stamp, false))
+        return;
+    std::ifstream fin(ruleFilePath, std::ios::in | std::ios::binary);
+    if(!fin.is_open())
+    {
+        std::cerr << "Error: open file failed!" << std::endl;
+        exit(-1);
+    }
+    std::string content((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    stamp._hash = hashBytes(content);
+    if(out.load(cachePath, flags, stamp, true))
+    {
+        out.save(cachePath, stamp);
+        return;
+    }
+    // NFA和子集构造得到的DFA只在编译时需要, 出作用域即释放
+    std::unique_ptr<CompiledDFA> built;
+    {
+        NFA nfa(loadGrammar(ruleFilePath));
+        DFA dfa(nfa);
+        built.reset(new CompiledDFA(dfa));
+    }
+    CompiledDFA& compiled = *built;
+    if(minimized)
+        compiled.minimize();
+    if(!compiled.save(cachePath, stamp) || !out.load(cachePath, flags, stamp, true))
+    {
+        std::cerr << "Warning: 写入编译后的DFA文件" << cachePath << "失败" << std::endl;
+        out._numStates = compiled._numStates;
+        out._numClasses = compiled._numClasses;
+        out._startState = compiled._startState;
+        out._flags = compiled._flags;
+        out._ownedClassMap.assign(compiled._classMap, compiled._classMap + 256);
+        out._ownedTrans.assign(compiled._trans, compiled._trans + compiled._numStates * compiled._numClasses);
+        out._ownedAcceptBits.assign(compiled._acceptBits, compiled._acceptBits + (compiled._numStates + 63) / 64);
+        out.bindOwned();
+    }
+}
+
+// 多DFA同时匹配: 对一个输入串只扫描一遍, 得到每个DFA是否接受
+// 积自动机的状态数不超过productLimit时直接构造积自动机, 每个字符只需一次查表
+// 否则把所有DFA的状态统一编号, 用状态向量同步推进所有自动机
+class MultiDFA
+{
+private:
+    std::vector<const CompiledDFA*> _dfas;
+    // 全局字符类: 两个字符在每个DFA中都属于同一字符类时才属于同一个全局字符类
+    // 各DFA自身最多256个字符类, 但组合后每个字符都可以自成一类, 再加上公共的字符类0最多257个, 用uint16_t存放
+    std::vector<uint16_t> _classMap;
+    int _numClasses;
+    // 每个DFA的字符类到全局字符类的投影, _localClass[DFA下标][全局字符类]
+    std::vector<std::vector<int>> _localClass;
+
+    bool _useProduct;
+    // 积自动机, 状态0为所有分量都是死状态的元组
+    int _productStart;
+    int _productStates;
+    std::vector<int32_t> _productTrans;
+    // 每个积状态占_words个字, 第k位表示第k个DFA接受
+    int _words;
+    std::vector<uint64_t> _productAccept;
+
+    // 并行推进: 全局状态0是公共的死状态, 第k个DFA的状态s(s>=1)编号为_offset[k] + s - 1
+    int _totalStates;
+    std::vector<int32_t> _offset;
+    std::vector<int32_t> _startStates;
+    // 按字符类分行的转移表, _stepTable[全局字符类 * _totalStates + 全局状态]
+    // 同一字符下所有自动机查的是同一行, 内层循环是对状态向量的gather, 编译器可以向量化
+    std::vector<int32_t> _stepTable;
+    std::vector<uint64_t> _globalAccept;
+
+    void buildClassMap()
+    {
+        std::map<std::vector<int>, int> signatures;
+        std::vector<int> zero(_dfas.size(), 0);
+        signatures[zero] = 0;
+        _localClass.assign(_dfas.size(), std::vector<int>(1, 0));
+        _classMap.assign(256, 0);
+        for(int c = 0; c < 256; ++c)
+        {
+            std::vector<int> sig(_dfas.size());
+            for(int k = 0; k < _dfas.size(); ++k)
+                sig[k] = _dfas[k]->classOf(c);
+            auto it = signatures.find(sig);
+            if(it == signatures.end())
+            {
+                int id = signatures.size();
+                it = signatures.insert({sig, id}).first;
+                for(int k = 0; k < _dfas.size(); ++k)
+                    _localClass[k].push_back(sig[k]);
+            }
+            _classMap[c] = it->second;
+        }
+        _numClasses = signatures.size();
+    }
+
+    // 广度优先构造积自动机, 状态数超过limit时放弃
+    bool buildProduct(int limit)
+    {
+        std::map<std::vector<int32_t>, int> index;
+        std::vector<std::vector<int32_t>> tuples;
+        std::vector<int32_t> dead(_dfas.size(), 0);
+        index[dead] = 0;
+        tuples.push_back(dead);
+        std::vector<int32_t> start(_dfas.size());
+        for(int k = 0; k < _dfas.size(); ++k)
+            start[k] = _dfas[k]->_startState;
+        if(index.find(start) == index.end())
+        {
+            index[start] = tuples.size();
+            tuples.push_back(start);
+        }
+        _productStart = index[start];
+        _productTrans.clear();
+        for(int i = 0; i < tuples.size(); ++i)
+        {
+            for(int c = 0; c < _numClasses; ++c)
+            {
+                std::vector<int32_t> to(_dfas.size());
+                for(int k = 0; k < _dfas.size(); ++k)
+                    to[k] = _dfas[k]->next(tuples[i][k], _localClass[k][c]);
+                auto it = index.find(to);
+                if(it == index.end())
+                {
+                    if(tuples.size() >= limit)
+                        return false;
+                    it = index.insert({to, (int)tuples.size()}).first;
+                    tuples.push_back(to);
+                }
+                _productTrans.push_back(it->second);
+            }
+        }
+        _productStates = tuples.size();
+        _productAccept.assign(_productStates * _words, 0);
+        for(int i = 0; i < _productStates; ++i)
+        {
+            for(int k = 0; k < _dfas.size(); ++k)
+            {
+                if(_dfas[k]->isAccept(tuples[i][k]))
+                    _productAccept[i * _words + k / 64] |= 1ULL << (k % 64);
+            }
+        }
+        return true;
+    }
+
+    void buildLockstep()
+    {
+        _totalStates = 1;
+        _offset.resize(_dfas.size());
+        _startStates.resize(_dfas.size());
+        for(int k = 0; k < _dfas.size(); ++k)
+        {
+            _offset[k] = _totalStates;
+            _totalStates += _dfas[k]->_numStates - 1;
+        }
+        auto global = [this](int k, int s) { return s == 0 ? 0 : _offset[k] + s - 1; };
+        _stepTable.assign(_numClasses * _totalStates, 0);
+        _globalAccept.assign((_totalStates + 63) / 64, 0);
+        for(int k = 0; k < _dfas.size(); ++k)
+        {
+            const CompiledDFA& d = *_dfas[k];
+            _startStates[k] = global(k, d._startState);
+            for(int s = 1; s < d._numStates; ++s)
+            {
+                int g = global(k, s);
+                for(int c = 0; c < _numClasses; ++c)
+                    _stepTable[c * _totalStates + g] = global(k, d.next(s, _localClass[k][c]));
+                if(d.isAccept(s))
+                    _globalAccept[g / 64] |= 1ULL << (g % 64);
+            }
+        }
+    }
+
+public:
+    MultiDFA(const std::vector<const CompiledDFA*>& dfas, int productLimit = 4096)
+        : _dfas(dfas), _words((dfas.size() + 63) / 64)
+    {
+        buildClassMap();
+        _useProduct = buildProduct(productLimit);
+        if(!_useProduct)
+        {
+            _productTrans.clear();
+            buildLockstep();
+        }
+    }
+
+    bool usesProduct() const { return _useProduct; }
+    int stateCount() const { return _useProduct ? _productStates : _totalStates; }
+
+    // 返回每个DFA是否接受str
+    std::vector<bool> match(const std::string& str) const
+    {
+        std::vector<bool> ret(_dfas.size(), false);
+        if(_useProduct)
+        {
+            int s = _productStart;
+            for(auto& c : str)
+                s = _productTrans[s * _numClasses + _classMap[(unsigned char)c]];
+            for(int k = 0; k < _dfas.size(); ++k)
+                ret[k] = (_productAccept[s * _words + k / 64] >> (k % 64)) & 1;
+            return ret;
+        }
+        std::vector<int32_t> cur(_startStates);
+        int32_t* states = cur.data();
+        const int n = cur.size();
+        for(auto& c : str)
+        {
+            const int32_t* row = _stepTable.data() + _classMap[(unsigned char)c] * _totalStates;
+            for(int k = 0; k < n; ++k)
+                states[k] = row[states[k]];
+        }
+        for(int k = 0; k < n; ++k)
+            ret[k] = (_globalAccept[states[k] / 64] >> (states[k] % 64)) & 1;
+        return ret;
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    // 多DFA匹配模式: NFA2DFA -m [-O] <待匹配串> <ruleFilePath1> <ruleFilePath2> ...
+    // 编译后的DFA缓存在<ruleFilePath>.cdfa中, -O表示使用最小化的DFA(缓存在<ruleFilePath>.min.cdfa中)
+    auto usage = [&]() {
         std::cerr << "Usage: " << argv[0] << " <ruleFilePath>" << std::endl;
+        std::cerr << "       " << argv[0] << " -m [-O] <string> <ruleFilePath>..." << std::endl;
         exit(-1);
+    };
+    if(argc >= 2 && std::string(argv[1]) == "-m")
+    {
+        int argi = 2;
+        bool minimized = false;
+        if(argi < argc && std::string(argv[argi]) == "-O")
+        {
+            minimized = true;
+            ++argi;
+        }
+        // 待匹配串之后至少要有一个文法文件
+        if(argi + 1 >= argc)
+            usage();
+        std::string str = argv[argi++];
+        std::vector<std::unique_ptr<CompiledDFA>> compiled;
+        std::vector<const CompiledDFA*> dfas;
+        for(int i = argi; i < argc; ++i)
+        {
+            compiled.emplace_back(new CompiledDFA());
+            loadCompiledDFA(argv[i], minimized, *compiled.back());
+            dfas.push_back(compiled.back().get());
+        }
+        MultiDFA multi(dfas);
+        std::cout << (multi.usesProduct() ? "积自动机" : "并行推进") << ", 状态数: " << multi.stateCount() << std::endl;
+        auto result = multi.match(str);
+        for(int i = 0; i < result.size(); ++i)
+            std::cout << argv[i + argi] << ": " << (result[i] ? "接受" : "拒绝") << std::endl;
+        return 0;
     }
+    if(argc != 2)
+        usage();
     ruleFilePath = argv[1];
     init();
     NFA nfa(grammar);
@@ -6,6 +6,17 @@
 #include <unordered_map>
 #include <set>
 #include <deque>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include "../common/FirstFollow.h"
+#include "../lab1/tokenizer.h"
 
 // 规则A->&， &表示空串
 struct productionRule
@@ -46,6 +57,16 @@ struct Grammar
             os << p << std::endl;
         return os << std::endl;
     }
+    inline bool isTerminal(char c) const
+    {
+        return std::find(_terminalSymbols.begin(), _terminalSymbols.end(), c) != _terminalSymbols.end();
+    }
+
+    inline bool isNonTerminal(char c) const
+    {
+        return std::find(_nonTerminalSymbols.begin(), _nonTerminalSymbols.end(), c) != _nonTerminalSymbols.end();
+    }
+
     inline int getIndexOfNonTerminal(char c) const
     {
         for(int i = 0; i < _nonTerminalSymbols.size(); ++i)
@@ -67,364 +88,1037 @@ struct Grammar
 
 } grammar;
 
-const std::string ruleFilePath = "./production_rule.txt";
-const std::string sentence = "(n+n)*n-n/n#";
+std::string ruleFilePath = "./production_rule.txt";
+std::string sentence = "(n+n)*n-n/n#";
+std::string catagoryFilePath = "../lab1/catagory.txt";
 // const std::string ruleFilePath = "./test.txt";
 // const std::string sentence = "010101010000100#";
 // const std::string ruleFilePath = "./test1.txt";
 // const std::string sentence = "adbc#";
 
-typedef std::vector<std::vector<productionRule>> PredictTable;
 
-std::vector<std::string> FileRead(const std::string &filepath)
+
+// 文法分析结果: 可推空的非终结符、First集合、Follow集合
+// 文法符号按终结符在前、非终结符在后编成稠密编号后交给FirstFollowEngine, 构造时一次性求出, 构造预测分析表和打印时共享
+// 终结符的编号就是它在_terminalSymbols中的下标(预测分析表的列), 非终结符的编号减去终结符个数就是行下标
+struct GrammarAnalysis
 {
-    std::vector<std::string> ret;
-    std::fstream fin(filepath, std::ios::in);
-    if(!fin.is_open())
+    // 字符 -> 符号编号, -1表示不是文法符号, 空串&也是-1
+    int _symbolId[256];
+    // 符号编号 -> 字符
+    std::vector<char> _symbols;
+    // 编码后的产生式, 与_productionRules一一对应, 右部去掉了&
+    std::vector<int> _lhs;
+    std::vector<std::vector<int>> _rhs;
+    FirstFollowEngine _engine;
+
+    GrammarAnalysis(const Grammar& g)
     {
-        std::cerr << "Error: open file failed!" << std::endl;
-        exit(-1);
+        std::fill(_symbolId, _symbolId + 256, -1);
+        for(const auto& c : g._terminalSymbols)
+        {
+            _symbolId[(unsigned char)c] = _symbols.size();
+            _symbols.push_back(c);
+        }
+        for(const auto& c : g._nonTerminalSymbols)
+        {
+            _symbolId[(unsigned char)c] = _symbols.size();
+            _symbols.push_back(c);
+        }
+        for(const auto& p : g._productionRules)
+        {
+            _lhs.push_back(_symbolId[(unsigned char)p._lhs]);
+            _rhs.push_back(encode(p._rhs));
+        }
+        _engine.compute(g._terminalSymbols.size(), g._nonTerminalSymbols.size(), _lhs, _rhs,
+                        _symbolId[(unsigned char)g._startSymbol], _symbolId[(unsigned char)'#']);
+    }
+
+    // 把符号串编码为符号编号序列, 空串&被去掉
+    std::vector<int> encode(const std::string& s) const
+    {
+        std::vector<int> ret;
+        for(const auto& c : s)
+        {
+            if(c != '&')
+                ret.push_back(_symbolId[(unsigned char)c]);
+        }
+        return ret;
     }
-    std::string line;
-    while(getline(fin, line))
-        ret.push_back(line);
-    return ret;
-}
 
+    inline bool isNullable(char c) const
+    {
+        return c == '&' || _engine.nullable(_symbolId[(unsigned char)c]);
+    }
 
+    // 第k条产生式右部的First集合并入out, 返回右部是否可以推出空串
+    inline bool productionFirst(int k, SymbolSet& out) const
+    {
+        return _engine.stringFirst(_rhs[k].data(), _rhs[k].data() + _rhs[k].size(), out);
+    }
 
-class LL1Parser{
-public:
-    LL1Parser() = default;
-    ~LL1Parser() = default;
-    inline bool isTerminal(char c, const Grammar& g)
+    inline const SymbolSet& follow(char A) const
     {
-        return std::find(g._terminalSymbols.begin(), g._terminalSymbols.end(), c) != g._terminalSymbols.end();
+        return _engine.follow(_symbolId[(unsigned char)A]);
     }
 
-    inline bool isNonTerminal(char c, const Grammar& g)
+    std::set<char> toCharSet(const SymbolSet& set) const
     {
-        return std::find(g._nonTerminalSymbols.begin(), g._nonTerminalSymbols.end(), c) != g._nonTerminalSymbols.end();
+        std::set<char> ret;
+        set.forEach([&](int t) { ret.insert(_symbols[t]); });
+        return ret;
     }
 
-    // 对一个文法符号串求First集合，在求Follow集合以及构造预测分析表时使用
-    std::set<char> getStringFirstSet(const std::string& s, const Grammar& g)
+    // 所有非终结符的First集合, 可推空时包含&, 用于打印
+    std::map<char, std::set<char>> firstSets() const
     {
-        std::set<char> firstSet;
-        if(s.empty())
-            return firstSet;
-        // 如果第一个符号是终结符，直接加入到First集合中
-        if(isTerminal(s[0], g))
-            firstSet.insert(s[0]);
-        // 如果第一个符号是非终结符，递归计算其First集合
-        else
+        std::map<char, std::set<char>> ret;
+        for(int X = _engine.numTerminals(); X < _symbols.size(); ++X)
+        {
+            ret[_symbols[X]] = toCharSet(_engine.first(X));
+            if(_engine.nullable(X))
+                ret[_symbols[X]].insert('&');
+        }
+        return ret;
+    }
+
+    // 所有非终结符的Follow集合, 用于打印
+    std::map<char, std::set<char>> followSets() const
+    {
+        std::map<char, std::set<char>> ret;
+        for(int X = _engine.numTerminals(); X < _symbols.size(); ++X)
+            ret[_symbols[X]] = toCharSet(_engine.follow(X));
+        return ret;
+    }
+};
+
+// LL1预测分析表
+// 行为非终结符、列为终结符, 表项为int16的产生式编号, -1表示出错
+// 符号编号与GrammarAnalysis一致, 终结符0..T-1, 非终结符T..T+N-1, 都不超过int16
+// 产生式右部编码后逆序存放在_rhsSymbols中, 展开时按顺序拷贝到栈顶即可, 空串对应空区间
+// 有冲突的格子存放-2-d, d是_decisions中的决策编号, 分析到这里时由AdaptivePredictor向前看多个符号选择产生式
+class AdaptivePredictor;
+struct PredictTable
+{
+    int _numTerminals;
+    int _numNonTerminals;
+    int16_t _startSymbol;
+    int16_t _endMarker;
+    // 字符 -> 终结符编号, -1表示不是终结符
+    int16_t _terminalOf[256];
+    // 符号编号 -> 字符
+    std::vector<char> _symbols;
+    // _cells[(非终结符编号 - _numTerminals) * _numTerminals + 终结符编号]
+    std::vector<int16_t> _cells;
+    // 第k条产生式逆序后的右部为_rhsSymbols[_rhsBegin[k], _rhsBegin[k + 1])
+    std::vector<int16_t> _rhsSymbols;
+    std::vector<int32_t> _rhsBegin;
+    // 最长的产生式右部, 展开前用来检查栈空间
+    int _maxRhsLength;
+    // 原始产生式, 用于打印
+    std::vector<productionRule> _productions;
+    // 同一格中有多条产生式时先填入的是LL1下保留的, 其余的记在这里, 为空说明文法是LL1的
+    struct Conflict
+    {
+        int _nonTerminal;
+        int _terminal;
+        int _kept;
+        int _rejected;
+    };
+    std::vector<Conflict> _conflicts;
+    // 每个冲突格对应一个决策, 候选产生式按编号排列, _default是LL1下保留的那条
+    struct Decision
+    {
+        int16_t _nonTerminal;
+        int16_t _terminal;
+        int16_t _default;
+        std::vector<int16_t> _alternatives;
+    };
+    std::vector<Decision> _decisions;
+    // 各决策的向前看DFA缓存, 表的副本之间共享
+    std::shared_ptr<AdaptivePredictor> _adaptive;
+
+    inline int16_t predict(int nonTerminal, int terminal) const
+    {
+        return _cells[(nonTerminal - _numTerminals) * _numTerminals + terminal];
+    }
+
+    // 只能向前看一个符号的分析器使用: 冲突格取LL1下保留的产生式
+    inline int16_t predictLL1(int nonTerminal, int terminal) const
+    {
+        int16_t k = predict(nonTerminal, terminal);
+        return k < -1 ? _decisions[-k - 2]._default : k;
+    }
+};
+
+// 冲突格的自适应预测, 思路同ALL(*)
+// 对决策的每个候选产生式模拟分析后续的实际输入, 直到只剩一个候选还能继续匹配为止
+// 不需要调用上下文就能区分的情况(SLL)记在该决策的向前看DFA里: 状态是各候选的模拟栈集合, 按终结符转移,
+// 以后再到这个决策时沿DFA走已经算过的转移, 和查表差不多快
+// 某个候选的模拟栈弹空、需要看分析栈中下面的符号时, 结果与上下文有关, DFA状态标记为需要完整上下文,
+// 到这里改为带着实际分析栈重新模拟(LL), 结果不缓存
+// 所有候选都能分析到输入结束时文法有歧义, 优先选LL1下保留的产生式
+// DFA的扩充用每个决策各自的互斥量保护, 多个线程可以共享同一张预测分析表
+class AdaptivePredictor
+{
+private:
+    // 一个候选的模拟状态: 局部栈(栈顶在尾部)下面接着分析栈的[0, _base)
+    struct Config
+    {
+        int16_t _alt;
+        int32_t _base;
+        std::vector<int16_t> _local;
+
+        bool operator<(const Config& o) const
+        {
+            if(_alt != o._alt)
+                return _alt < o._alt;
+            if(_base != o._base)
+                return _base < o._base;
+            return _local < o._local;
+        }
+        bool operator==(const Config& o) const
+        {
+            return _alt == o._alt && _base == o._base && _local == o._local;
+        }
+    };
+    struct DFAState
+    {
+        std::vector<Config> _configs;
+        std::vector<int32_t> _next;     // 按终结符的转移, -1表示还没有算过
+        int16_t _prediction;            // >=0表示到这里已经确定了产生式
+        bool _fullContext;
+        bool _error;
+    };
+    struct DecisionDFA
+    {
+        std::mutex _mutex;
+        std::vector<DFAState> _states;
+        std::map<std::vector<int16_t>, int32_t> _index;
+    };
+
+    // 每个决策的DFA状态数和模拟时的配置数上限, 超过后不再缓存/直接取默认产生式
+    static const int MAX_STATES = 4096;
+    static const int MAX_CONFIGS = 1 << 14;
+
+    std::vector<std::unique_ptr<DecisionDFA>> _dfas;
+
+    static inline int terminalAt(const PredictTable& table, const char* str, size_t n, size_t p)
+    {
+        return p < n ? table._terminalOf[(unsigned char)str[p]] : table._endMarker;
+    }
+
+    static inline void pushRhs(const PredictTable& table, int k, std::vector<int16_t>& local)
+    {
+        local.insert(local.end(), table._rhsSymbols.begin() + table._rhsBegin[k], table._rhsSymbols.begin() + table._rhsBegin[k + 1]);
+    }
+
+    // 把每个配置展开到栈顶是终结符, 再匹配终结符a, 能匹配的配置放入out并去重
+    // context为空时不看调用上下文, 有配置的栈弹空时返回false
+    static bool step(const PredictTable& table, const std::vector<Config>& in, int a, const int16_t* context, std::vector<Config>& out)
+    {
+        const int T = table._numTerminals;
+        const int limit = table._productions.size() * (table._maxRhsLength + 1) + 1;
+        out.clear();
+        if(a < 0)
+            return true;
+        std::vector<Config> work(in.rbegin(), in.rend());
+        while(!work.empty())
         {
-            auto allFirstSet = calculateFirstSet(g);
-            firstSet = allFirstSet[s[0]];
-            // 如果First集合中包含空串，继续往后推
-            if(firstSet.find('&') != firstSet.end())
+            Config c = std::move(work.back());
+            work.pop_back();
+            bool alive = false;
+            for(int expansions = 0; expansions <= limit; ++expansions)
             {
-                int idx = 1;
-                bool next = true;
-                while(next && idx < s.size())
+                int Y;
+                if(!c._local.empty())
+                    Y = c._local.back();
+                else if(!context)
+                    return false;
+                else if(c._base > 0)
+                    Y = context[c._base - 1];
+                else
+                    break;
+                if(c._local.empty())
+                    --c._base;
+                else
+                    c._local.pop_back();
+                if(Y < T)
                 {
-                    next = false;
-                    char Y = s[idx];
-                    std::set<char> firstY = allFirstSet[Y];
-                    for(const auto& c : firstY)
+                    alive = Y == a;
+                    break;
+                }
+                int k = table.predict(Y, a);
+                if(k == -1)
+                    break;
+                if(k < -1)
+                {
+                    // 嵌套的冲突格, 每个候选各分出一个配置
+                    const auto& alts = table._decisions[-k - 2]._alternatives;
+                    for(int i = alts.size() - 1; i > 0; --i)
                     {
-                        if(c != '&')
-                            firstSet.insert(c);
-                        // 当前符号的First集合中包含空串，继续往后推
-                        else
-                            next = true;
+                        work.push_back(c);
+                        pushRhs(table, alts[i], work.back()._local);
                     }
-                    if(next)
-                        idx++;
+                    k = alts[0];
                 }
-                // 如果所有符号的First集合中都包含空串，那么该符号串的First集合中也要加入空串
-                if(idx == s.size())
-                    firstSet.insert('&');
+                pushRhs(table, k, c._local);
             }
+            if(alive)
+                out.push_back(std::move(c));
         }
-        return firstSet;
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        return true;
     }
 
-    // 求对应文法的First集合
-    std::map<char, std::set<char>> calculateFirstSet(const Grammar& g)
+    // 配置集合中只剩一个候选时返回它, 没有配置返回-1, 还有多个候选返回-2
+    static int single(const std::vector<Config>& configs)
     {
-        std::map<char, std::set<char>> firstSet;
-        // 终结符的First集合为其本身
-        for(const auto& c : g._terminalSymbols)
-            firstSet[c].insert(c);
-        // 非终结符的First集合初始化为空
-        for(const auto& c : g._nonTerminalSymbols)
-            firstSet[c] = {};
-        // 空串对应的First集合为{&}
-        // 需要有这个初始化，否则后续构造分析表的时候，对于空串的First集合返回为空集合，无法判断(其实可以判断，在判断时看集合是否为空，但是这样写更加清晰)
-        firstSet['&'].insert('&');
-        // 遍历产生式规则，计算First集合
-        bool change = true;
-        while(change)
-        {
-            change = false;
-            for(const auto& p : g._productionRules)
-            {
-                char lhs = p._lhs;
-                std::string rhs = p._rhs;
-                // 如果右部第一个符号是终结符或者右部是空串，直接加入到First集合中
-                if(isTerminal(rhs[0], g) || rhs[0] == '&')
+        if(configs.empty())
+            return -1;
+        for(const auto& c : configs)
+        {
+            if(c._alt != configs[0]._alt)
+                return -2;
+        }
+        return configs[0]._alt;
+    }
+
+    std::vector<int16_t> key(const std::vector<Config>& configs) const
+    {
+        std::vector<int16_t> ret;
+        for(const auto& c : configs)
+        {
+            ret.push_back(c._alt);
+            ret.push_back(c._local.size());
+            ret.insert(ret.end(), c._local.begin(), c._local.end());
+        }
+        return ret;
+    }
+
+    // 带着实际分析栈模拟, stack[0, base)是决策所在非终结符下面的分析栈
+    int fullPredict(const PredictTable& table, int d, const char* str, size_t n, size_t idx, const int16_t* stack, int base) const
+    {
+        const auto& decision = table._decisions[d];
+        std::vector<Config> configs, next;
+        for(auto alt : decision._alternatives)
+        {
+            configs.push_back({alt, base, std::vector<int16_t>()});
+            pushRhs(table, alt, configs.back()._local);
+        }
+        for(size_t p = idx; ; ++p)
+        {
+            int a = terminalAt(table, str, n, p);
+            step(table, configs, a, stack, next);
+            int alt = single(next);
+            if(alt != -2)
+                return alt;
+            if(a == table._endMarker || next.size() > MAX_CONFIGS)
+            {
+                // 歧义或者模拟规模太大, 在剩下的候选中优先选默认产生式
+                for(const auto& c : next)
                 {
-                    // 如果First集合中没有该终结符，加入到First集合中
-                    if(firstSet[lhs].find(rhs[0]) == firstSet[lhs].end())
-                    {
-                        firstSet[lhs].insert(rhs[0]);
-                        change = true; // 标注First集合发生了变化，最外层while循环需要继续
-                    }
+                    if(c._alt == decision._default)
+                        return decision._default;
                 }
-                // 此时右部第一个符号一定是非终结符
-                else
+                return next[0]._alt;
+            }
+            configs.swap(next);
+        }
+    }
+
+public:
+    explicit AdaptivePredictor(int numDecisions)
+    {
+        for(int d = 0; d < numDecisions; ++d)
+            _dfas.emplace_back(new DecisionDFA());
+    }
+
+    // 在输入串str的第idx个字符处对决策d做预测, 返回产生式编号, 所有候选都无法继续时返回-1
+    int predict(const PredictTable& table, int d, const char* str, size_t n, size_t idx, const int16_t* stack, int base)
+    {
+        DecisionDFA& dfa = *_dfas[d];
+        std::unique_lock<std::mutex> lock(dfa._mutex);
+        if(dfa._states.empty())
+        {
+            DFAState start;
+            for(auto alt : table._decisions[d]._alternatives)
+            {
+                start._configs.push_back({alt, 0, std::vector<int16_t>()});
+                pushRhs(table, alt, start._configs.back()._local);
+            }
+            start._next.assign(table._numTerminals, -1);
+            start._prediction = -1;
+            start._fullContext = start._error = false;
+            dfa._states.push_back(std::move(start));
+        }
+        int s = 0;
+        for(size_t p = idx; ; ++p)
+        {
+            int a = terminalAt(table, str, n, p);
+            if(a < 0)
+                return -1;
+            int next = dfa._states[s]._next[a];
+            if(next < 0)
+            {
+                DFAState state;
+                state._fullContext = !step(table, dfa._states[s]._configs, a, nullptr, state._configs);
+                int alt = single(state._configs);
+                state._prediction = state._fullContext || alt < 0 ? -1 : alt;
+                state._error = !state._fullContext && alt == -1;
+                if(state._fullContext)
+                    state._configs.clear();
+                auto k = key(state._configs);
+                k.push_back(state._fullContext);
+                auto it = dfa._index.find(k);
+                if(it != dfa._index.end())
+                    next = it->second;
+                else if(dfa._states.size() < MAX_STATES)
                 {
-                    // 如果右部第一个非终结符可以推出空，还需要继续往后推，需要一个next标志
-                    bool next = true;
-                    // 待判断符号的下标
-                    int idx = 0;
-                    while(next && idx < rhs.size())
-                    {
-                        next = false;
-                        char Y = rhs[idx]; // 第一次循环时Y是右部第一个非终结符
-                        std::set<char> firstY = firstSet[Y];
-                        // 可以直接把First(Y)加入到First(lhs)中
-                        // 在此处两种情况：第一次循环进入，说明是右部第一个非终结符，直接加入没问题
-                        // 此后再次能进入循环说明前一个符号为空串，也可以直接加入
-                        for(const auto& c : firstY)
-                        {
-                            if(c != '&')
-                            {
-                                if(firstSet[lhs].find(c) == firstSet[lhs].end())
-                                {
-                                    firstSet[lhs].insert(c);
-                                    change = true;
-                                }
-                            }
-                            else
-                                next = true;
-                        }
-                        // 如果First(Y)中包含空串，继续往后推,下标加1
-                        if(next)
-                            idx++;
-                    }
-                    // X->Y1Y2...Yn, 如果Y1Y2...Yn都能推出空串，那么X的First集合中也要加入空串
-                    if(idx == rhs.size())
-                    {
-                        if(firstSet[lhs].find('&') == firstSet[lhs].end())
-                        {
-                            firstSet[lhs].insert('&');
-                            change = true;
-                        }
-                    }
+                    next = dfa._states.size();
+                    state._next.assign(table._numTerminals, -1);
+                    dfa._index[k] = next;
+                    dfa._states.push_back(std::move(state));
                 }
+                else
+                    break;
+                dfa._states[s]._next[a] = next;
+            }
+            s = next;
+            const DFAState& state = dfa._states[s];
+            if(state._error)
+                return -1;
+            if(state._prediction >= 0)
+                return state._prediction;
+            if(state._fullContext)
+                break;
+        }
+        lock.unlock();
+        return fullPredict(table, d, str, n, idx, stack, base);
+    }
+
+    // 各决策DFA的状态数, 用于观察缓存的规模
+    std::vector<int> stateCounts()
+    {
+        std::vector<int> ret;
+        for(auto& dfa : _dfas)
+        {
+            std::lock_guard<std::mutex> lock(dfa->_mutex);
+            ret.push_back(dfa->_states.size());
+        }
+        return ret;
+    }
+};
+
+// 把lab1词法分析器产生的单词流转换成终结符编号流, LL1分析器每匹配掉一个终结符才向词法分析器要下一个单词
+// 标识符和常数都对应终结符n, 拼写只有一个字符的运算符和界符对应同名的终结符, 注释直接跳过
+class TokenStream
+{
+private:
+    static const int16_t SKIP = -2;
+
+    Tokenizer& _tokenizer;
+    int16_t _endMarker;
+    // 种别码 -> 终结符编号, -1表示文法中没有对应的终结符
+    int16_t _terminalOfCode[CODE_NUM];
+    token _token;
+    size_t _count;
+
+public:
+    TokenStream(Tokenizer& tokenizer, const PredictTable& table)
+        : _tokenizer(tokenizer), _endMarker(table._endMarker), _count(0)
+    {
+        for(int code = 0; code < CODE_NUM; ++code)
+        {
+            const std::string& s = tokenizer.spelling(code);
+            _terminalOfCode[code] = s.size() == 1 ? table._terminalOf[(unsigned char)s[0]] : -1;
+            if(s == "/*" || s == "*/")
+                _terminalOfCode[code] = SKIP;
+        }
+        int16_t n = table._terminalOf[(unsigned char)'n'];
+        _terminalOfCode[ID_CODE] = _terminalOfCode[INT_CODE] = _terminalOfCode[DOUBLE_CODE] = n;
+        _terminalOfCode[COMMENT_CODE] = SKIP;
+    }
 
+    // 取下一个终结符编号, 源程序结束时返回#的编号, 词法错误或没有对应的终结符时返回-1
+    int next()
+    {
+        while(1)
+        {
+            int code = _tokenizer.nextToken(_token);
+            if(code == _EOF_)
+                return _endMarker;
+            if(code < 0 || code >= CODE_NUM)
+                return -1;
+            if(_terminalOfCode[code] != SKIP)
+            {
+                ++_count;
+                return _terminalOfCode[code];
             }
         }
-        return firstSet;
     }
 
-    // 求对应文法的Follow集合
-    std::map<char, std::set<char>> calculateFollowSet(const Grammar& g)
+    // 最近取到的单词, 出错时用来报告位置
+    const token& current() const
     {
-        std::map<char, std::set<char>> followSet;
-        // 非终结符的Follow集合初始化为空
-        for(const auto& c : g._nonTerminalSymbols)
-            followSet[c] = {};
-        // 开始符号的Follow集合中加入结束符号#
-        followSet[g._startSymbol].insert('#');
+        return _token;
+    }
+    int line() const
+    {
+        return _tokenizer.line();
+    }
+    // 已经取走的单词数(不含注释)
+    size_t count() const
+    {
+        return _count;
+    }
+};
+
+// LL1分析过程的输出级别
+enum TraceLevel
+{
+    TRACE_NONE,         // 不输出, 只返回分析结果和推导序列
+    TRACE_DERIVATION,   // 只输出每一步使用的产生式
+    TRACE_FULL          // 输出完整的分析表格: 步骤、栈、剩余输入、推导
+};
+
+// 分析过程输出的缓冲区, 攒够一块再整块写到输出流
+class TraceSink
+{
+private:
+    static const size_t FLUSH_SIZE = 1 << 16;
+    std::ostream& _os;
+    std::string _buffer;
+
+public:
+    // 缓冲区在第一次写入时才分配, 不输出时构造和析构都不涉及内存分配和输出流
+    TraceSink(std::ostream& os) : _os(os) {}
+    TraceSink(const TraceSink&) = delete;
+    ~TraceSink() { flush(); }
+
+    void flush()
+    {
+        if(_buffer.empty())
+            return;
+        _os.write(_buffer.data(), _buffer.size());
+        _os.flush();
+        _buffer.clear();
+    }
+
+    TraceSink& operator<<(char c)
+    {
+        _buffer += c;
+        if(_buffer.size() >= FLUSH_SIZE)
+            flush();
+        return *this;
+    }
+
+    TraceSink& operator<<(const char* s)
+    {
+        _buffer += s;
+        if(_buffer.size() >= FLUSH_SIZE)
+            flush();
+        return *this;
+    }
+
+    TraceSink& operator<<(const std::string& s)
+    {
+        _buffer += s;
+        if(_buffer.size() >= FLUSH_SIZE)
+            flush();
+        return *this;
+    }
+
+    TraceSink& operator<<(int n)
+    {
+        return *this << std::to_string(n);
+    }
+
+    TraceSink& operator<<(const productionRule& p)
+    {
+        return *this << p._lhs << "->" << p._rhs;
+    }
+};
+
+// 语法树结点
+struct ParseNode
+{
+    int16_t _symbol;        // 符号编号
+    int16_t _production;    // 非终结符展开所用的产生式编号, 终结符为-1
+    int32_t _length;        // 覆盖的输入字符数, 起点由父结点和前面的兄弟推出, 编辑后复用子树时不需要平移
+    int32_t _parent;        // 父结点, 根为-1
+    int32_t _firstChild;    // 孩子是_children[_firstChild, _firstChild + _childCount)
+    int32_t _childCount;
+};
+
+// 具体语法树
+// 结点和孩子下标都存放在连续数组中, 分配时只在尾部追加(bump分配), reset一次性释放整棵树并保留容量,
+// 重复分析时不再申请内存; 结点之间用下标而不是指针相互引用
+class ParseTree
+{
+public:
+    std::vector<ParseNode> _nodes;
+    std::vector<int32_t> _children;
+    int32_t _root;
+
+    ParseTree() : _root(-1) {}
+
+    void reset()
+    {
+        _nodes.clear();
+        _children.clear();
+        _root = -1;
+    }
+
+    inline int32_t newNode(int16_t symbol, int32_t parent)
+    {
+        ParseNode node;
+        node._symbol = symbol;
+        node._production = -1;
+        node._length = 0;
+        node._parent = parent;
+        node._firstChild = 0;
+        node._childCount = 0;
+        _nodes.push_back(node);
+        return _nodes.size() - 1;
+    }
+
+    // 在尾部一次分配n个连续的结点/孩子下标, 返回第一个的下标
+    inline int32_t allocNodes(int n)
+    {
+        int32_t first = _nodes.size();
+        _nodes.resize(first + n);
+        return first;
+    }
+
+    inline int32_t allocChildren(int n)
+    {
+        int32_t first = _children.size();
+        _children.resize(first + n);
+        return first;
+    }
 
-        // 遍历产生式规则，计算Follow集合
-        bool change = true;
-        while(change)
+    inline const ParseNode& child(const ParseNode& node, int i) const
+    {
+        return _nodes[_children[node._firstChild + i]];
+    }
+
+    // 孩子都比父结点后分配(或者是增量分析复用的旧结点, 长度已知), 倒序扫描[from, 结点数)一遍即可求出每个非终结符结点的长度
+    void computeLengths(int32_t from = 0)
+    {
+        for(int32_t i = (int32_t)_nodes.size() - 1; i >= from; --i)
         {
-            change = false;
-            for(auto& p : g._productionRules)
+            ParseNode& node = _nodes[i];
+            if(node._childCount > 0)
             {
-                char lhs = p._lhs;
-                std::string rhs = p._rhs;
-                for(int i = 0; i < rhs.size(); ++i)
-                {
-                    char X = rhs[i];
-                    // 如果X是非终结符
-                    if(isNonTerminal(X, g))
-                    {
-                        // X->aBb, 那么First(b)中的非空串加入到Follow(B)中
-                        std::set<char>& FollowB = followSet[X];
-                        auto b = rhs.substr(i + 1);
-                        std::set<char> firstb = getStringFirstSet(b, g);
-                        // 将firstb中的非空串加入到FollowB中
-                        for(auto& c : firstb)
-                        {
-                            if(c != '&')
-                            {
-                                if(FollowB.find(c) == FollowB.end())
-                                {
-                                    FollowB.insert(c);
-                                    change = true;
-                                }
-                            }
-                        }
-                        // X->aB, 那么Follow(A)中的非空串加入到Follow(B)中
-                        // 如果B是最后一个符号或者b->&，那么Follow(A)中的所有元素加入到Follow(B)中
-                        if(i == rhs.size() - 1 || firstb.find('&') != firstb.end())
-                        {
-                            std::set<char>& FollowA = followSet[lhs];
-                            for(auto& c : FollowA)
-                            {
-                                if(FollowB.find(c) == FollowB.end())
-                                {
-                                    FollowB.insert(c);
-                                    change = true;
-                                }
-                            }
-                        }
-                    }
-                }
+                node._length = 0;
+                for(int c = 0; c < node._childCount; ++c)
+                    node._length += _nodes[_children[node._firstChild + c]]._length;
             }
         }
-        return followSet;
     }
 
+    // 结点在输入串中的起点: 沿父结点向上, 累加前面兄弟的长度
+    int32_t begin(int32_t i) const
+    {
+        int32_t pos = 0;
+        while(_nodes[i]._parent >= 0)
+        {
+            const ParseNode& parent = _nodes[_nodes[i]._parent];
+            for(int c = 0; _children[parent._firstChild + c] != i; ++c)
+                pos += _nodes[_children[parent._firstChild + c]]._length;
+            i = _nodes[i]._parent;
+        }
+        return pos;
+    }
+
+    // 只保留从根可达的结点, 按先序重新编号, 增量分析留下的无用结点在这里回收
+    void compact()
+    {
+        if(_root < 0)
+            return;
+        std::vector<ParseNode> nodes;
+        std::vector<int32_t> children;
+        nodes.reserve(_nodes.size());
+        children.reserve(_children.size());
+        // 待复制的旧结点, 新的父结点, 以及它在新孩子表中的位置
+        struct Item
+        {
+            int32_t _old;
+            int32_t _parent;
+            int32_t _slot;
+        };
+        std::vector<Item> st;
+        st.push_back({_root, -1, -1});
+        while(!st.empty())
+        {
+            Item item = st.back();
+            st.pop_back();
+            int32_t id = nodes.size();
+            nodes.push_back(_nodes[item._old]);
+            nodes.back()._parent = item._parent;
+            if(item._slot >= 0)
+                children[item._slot] = id;
+            int32_t first = children.size();
+            int count = nodes.back()._childCount;
+            children.resize(first + count);
+            for(int c = count - 1; c >= 0; --c)
+                st.push_back({_children[_nodes[item._old]._firstChild + c], id, first + c});
+            nodes.back()._firstChild = first;
+        }
+        _nodes.swap(nodes);
+        _children.swap(children);
+        _root = 0;
+    }
+};
+
+class LL1Parser{
+private:
+    // 预先分配的符号栈, 分析过程中栈顶在尾部, 只在不够用时扩容
+    std::vector<int16_t> _symbolStack;
+    // 建语法树时与符号栈平行的结点栈, 记录每个栈中符号对应的树结点
+    std::vector<int32_t> _nodeStack;
+
+public:
+    LL1Parser() : _symbolStack(1024), _nodeStack(1024) {}
+    ~LL1Parser() = default;
+
     // 构造LL1预测分析表
-    PredictTable constructPredictTable(const Grammar& g)
+    PredictTable constructPredictTable(const Grammar& g, const GrammarAnalysis& analysis)
     {
         PredictTable predictTable;
         // 初始化预测分析表
-        predictTable.resize(g._nonTerminalSymbols.size());
-        for(auto& v : predictTable)
-            v.resize(g._terminalSymbols.size());
-        // std::cout << "预测分析表大小: " << predictTable.size() << " x " << predictTable[0].size() << std::endl;
+        predictTable._numTerminals = g._terminalSymbols.size();
+        predictTable._numNonTerminals = g._nonTerminalSymbols.size();
+        predictTable._symbols = analysis._symbols;
+        predictTable._startSymbol = analysis._symbolId[(unsigned char)g._startSymbol];
+        predictTable._endMarker = analysis._symbolId[(unsigned char)'#'];
+        for(int c = 0; c < 256; ++c)
+        {
+            int id = analysis._symbolId[c];
+            predictTable._terminalOf[c] = id >= 0 && id < predictTable._numTerminals ? id : -1;
+        }
+        predictTable._cells.assign(predictTable._numNonTerminals * predictTable._numTerminals, -1);
+        predictTable._productions = g._productionRules;
+        predictTable._maxRhsLength = 0;
+        for(int k = 0; k < analysis._rhs.size(); ++k)
+        {
+            const auto& rhs = analysis._rhs[k];
+            predictTable._rhsBegin.push_back(predictTable._rhsSymbols.size());
+            predictTable._rhsSymbols.insert(predictTable._rhsSymbols.end(), rhs.rbegin(), rhs.rend());
+            predictTable._maxRhsLength = std::max(predictTable._maxRhsLength, (int)rhs.size());
+        }
+        predictTable._rhsBegin.push_back(predictTable._rhsSymbols.size());
         // 遍历每一条产生式规则，填充预测分析表, A->a
-        for(auto& p : g._productionRules)
+        // First和Follow集合都是以终结符下标为元素的位集, 元素可以直接作为列下标
+        // 先填所有First(a)决定的格子, 再填Follow(A)决定的格子, 冲突时前者优先(例如悬空else选择移进else)
+        SymbolSet Firsta(g._terminalSymbols.size());
+        std::vector<char> nullable(g._productionRules.size());
+        for(int pass = 0; pass < 2; ++pass)
         {
-            auto lhs = p._lhs;
-            int row = g.getIndexOfNonTerminal(lhs);
-            auto Firsta = getStringFirstSet(p._rhs, g);
-            auto FollowA = calculateFollowSet(g)[lhs];
-            // std::cout << "First(" << p._rhs << ")={";
-            // for(auto& c : Firsta)
-            //     std::cout << " " << c;
-            // std::cout << " }" << std::endl;
-            // std::cout << "Follow(" << lhs << ")={";
-            // for(auto& c : FollowA)
-            //     std::cout << " " << c;
-            // std::cout << " }" << std::endl;
-            // 遍历First(a)中的每一个终结符，填充预测分析表
-            for(auto& a : Firsta)
-            {
-                if(a != '&')
+            for(int k = 0; k < g._productionRules.size(); ++k)
+            {
+                const auto& p = g._productionRules[k];
+                int row = g.getIndexOfNonTerminal(p._lhs);
+                auto fill = [&](int col) {
+                    int16_t& cell = predictTable._cells[row * predictTable._numTerminals + col];
+                    if(cell < 0)
+                        cell = k;
+                    else if(cell != k)
+                        predictTable._conflicts.push_back({row + predictTable._numTerminals, col, cell, k});
+                };
+                if(pass == 0)
                 {
-                    int col = g.getIndexOfTerminal(a);
-                    predictTable[row][col] = p;
-                    // std::cout << "predictTable[" << row << "][" << col << "]=" << p << std::endl;
+                    // 遍历First(a)中的每一个终结符，填充预测分析表
+                    Firsta.clear();
+                    nullable[k] = analysis.productionFirst(k, Firsta);
+                    Firsta.forEach(fill);
                 }
-            }
-            // 如果First(a)中包含空串，那么对于每一个b属于Follow(A)，填充预测分析表
-            if(Firsta.find('&') != Firsta.end() || Firsta.empty())
-            {
-                for(auto& b : FollowA)
+                else if(nullable[k])
                 {
-                    int col = g.getIndexOfTerminal(b);
-                    predictTable[row][col] = p;
-                    // std::cout << "predictTable[" << row << "][" << col << "]=" << p << std::endl;
+                    // 如果First(a)中包含空串，那么对于每一个b属于Follow(A)，填充预测分析表
+                    analysis.follow(p._lhs).forEach(fill);
                 }
             }
         }
+        // 冲突格改为决策编号, 候选是格中出现过的所有产生式
+        for(const auto& c : predictTable._conflicts)
+        {
+            int16_t& cell = predictTable._cells[(c._nonTerminal - predictTable._numTerminals) * predictTable._numTerminals + c._terminal];
+            if(cell >= 0)
+            {
+                cell = -2 - (int)predictTable._decisions.size();
+                predictTable._decisions.push_back({(int16_t)c._nonTerminal, (int16_t)c._terminal, (int16_t)c._kept, {(int16_t)c._kept}});
+            }
+            auto& alts = predictTable._decisions[-cell - 2]._alternatives;
+            if(std::find(alts.begin(), alts.end(), c._rejected) == alts.end())
+                alts.push_back(c._rejected);
+        }
+        for(auto& d : predictTable._decisions)
+            std::sort(d._alternatives.begin(), d._alternatives.end());
+        predictTable._adaptive = std::make_shared<AdaptivePredictor>(predictTable._decisions.size());
         return predictTable;
     }
 
-    // LL1分析
-    bool LL1Parse(const std::string& str, const Grammar& grammar)
+    // 输出分析过程中的一行: 步骤、栈、剩余输入、所用产生式
+    void printStep(TraceSink& out, int count, const int16_t* stack, int top, const std::string& str, int idx, const PredictTable& table, int production)
+    {
+        out << count << "\t\t";
+        for(int i = 0; i < top; ++i)
+            out << table._symbols[stack[i]];
+        out << "\t\t";
+        for(int i = idx; i < str.size(); ++i)
+            out << str[i];
+        out << "\t\t";
+        if(production >= 0)
+            out << table._productions[production];
+        out << '\n';
+    }
+
+    // LL1分析, 不修改预测分析表, 多个线程可以各用一个LL1Parser共享同一张表
+    // 栈中存放符号编号, 每一步只需查终结符映射和预测分析表, 展开时把逆序存放的右部整段拷贝到栈顶
+    // derivation不为空时按顺序记录使用的产生式编号(即最左推导序列)
+    // TRACE_FULL每一步都要输出整个栈和剩余输入, 输出量是输入长度的平方级, 只适合演示短句子
+    // tree不为空时同时建立具体语法树, 展开非终结符时一次分配右部所有符号的结点
+    bool LL1Parse(const std::string& str, const PredictTable& table,
+                  std::vector<int16_t>* derivation = nullptr, TraceLevel level = TRACE_NONE,
+                  ParseTree* tree = nullptr)
     {
-        // 为了方便打印栈里的元素，将deque当作栈用，栈顶在deque的尾部
-        std::deque<char> symbolStack;
-        PredictTable predictTable = constructPredictTable(grammar);
-        symbolStack.push_back('#');
-        symbolStack.push_back(grammar._startSymbol);
+        const int T = table._numTerminals;
+        // 单词流分析只扩容符号栈, 建树时结点栈要跟上符号栈的大小
+        if(tree && _nodeStack.size() < _symbolStack.size())
+            _nodeStack.resize(_symbolStack.size());
+        int16_t* stack = _symbolStack.data();
+        int32_t* nodes = _nodeStack.data();
+        int top = 0;
+        stack[top++] = table._endMarker;
+        stack[top++] = table._startSymbol;
+        if(tree)
+        {
+            tree->reset();
+            tree->_root = tree->newNode(table._startSymbol, -1);
+            nodes[0] = -1;
+            nodes[1] = tree->_root;
+        }
         int idx = 0; // 当前输入串的下标
         int count = 1; // 步骤计数
-        std::cout << "LL1分析过程:" << std::endl;
-        std::cout << "步骤" << "\t\t" << "栈" << "\t\t" << "输入" << "\t\t" << "推导" << std::endl;
-        std::cout << count++ << "\t\t";
-        for(auto& c : symbolStack)
-            std::cout << c;
-        std::cout << "\t\t";
-        for(int i = idx; i < str.size(); ++i)
-        std::cout << str[i];
-        std::cout << "\t\t" << std::endl;
+        TraceSink out(std::cout);
+        if(level == TRACE_FULL)
+        {
+            out << "LL1分析过程:" << '\n';
+            out << "步骤" << "\t\t" << "栈" << "\t\t" << "输入" << "\t\t" << "推导" << '\n';
+            printStep(out, count++, stack, top, str, idx, table, -1);
+        }
+        else if(level == TRACE_DERIVATION)
+            out << "LL1推导序列:" << '\n';
         while(1)
         {
-            char cur = str[idx];
-            char top = symbolStack.back();
-            if(top == '#' && cur == '#')
+            // 输入串末尾没有#时视为以#结束
+            char ch = idx < str.size() ? str[idx] : '#';
+            int cur = table._terminalOf[(unsigned char)ch];
+            int X = stack[top - 1];
+            if(X == table._endMarker && cur == table._endMarker)
+            {
+                if(tree)
+                    tree->computeLengths();
                 return true;
-            if(isTerminal(top, grammar))
+            }
+            if(X < T)
             {
-                if(top == cur)
+                if(X == cur)
                 {
-                    symbolStack.pop_back();
+                    if(tree)
+                        tree->_nodes[nodes[top - 1]]._length = 1;
+                    --top;
                     idx++;
-                    std::cout << count++ << "\t\t";
-                    for(auto& c : symbolStack)
-                        std::cout << c;
-                    std::cout << "\t\t";
-                    for(int i = idx; i < str.size(); ++i)
-                        std::cout << str[i];
-                    std::cout << "\t\t" << std::endl;
+                    if(level == TRACE_FULL)
+                        printStep(out, count++, stack, top, str, idx, table, -1);
                 }
                 else
                 {
-                    std::cout << "Error: 无法匹配" << std::endl;
+                    if(level != TRACE_NONE)
+                        out << "Error: 无法匹配" << '\n';
                     return false;
                 }
             }
             else
             {
-                int row = grammar.getIndexOfNonTerminal(top);
-                int col = grammar.getIndexOfTerminal(cur);
-                if(predictTable[row][col]._lhs == '\0')
+                int k = cur < 0 ? -1 : table.predict(X, cur);
+                // 冲突格向前看多个符号, X下面的分析栈是它的上下文
+                if(k < -1)
+                    k = table._adaptive->predict(table, -k - 2, str.data(), str.size(), idx, stack, top - 1);
+                if(k < 0)
                 {
-                    std::cout << "Error: 无法匹配," << "当前栈顶" << top << "当前字符" << cur << std::endl;
+                    if(level != TRACE_NONE)
+                        out << "Error: 无法匹配," << "当前栈顶" << table._symbols[X] << "当前字符" << ch << '\n';
                     return false;
                 }
-                else
+                --top;
+                // 栈空间不足时扩容, 扩容后需要重新取栈底指针
+                if(top + table._maxRhsLength > _symbolStack.size())
+                {
+                    _symbolStack.resize(_symbolStack.size() * 2 + table._maxRhsLength);
+                    _nodeStack.resize(_symbolStack.size());
+                    stack = _symbolStack.data();
+                    nodes = _nodeStack.data();
+                }
+                int rb = table._rhsBegin[k], re = table._rhsBegin[k + 1];
+                if(tree)
                 {
-                    symbolStack.pop_back();
-                    std::string rhs = predictTable[row][col]._rhs;
-                    // 空串不入栈， 其他符号逆序入栈
-                    if(rhs != "&")
+                    // 按右部从左到右的顺序分配孩子结点, 入栈时逆序对应
+                    int32_t parent = nodes[top];
+                    int32_t firstNode = tree->allocNodes(re - rb);
+                    int32_t firstChild = tree->allocChildren(re - rb);
+                    for(int i = 0; i < re - rb; ++i)
                     {
-                        for(int i = rhs.size() - 1; i >= 0; --i)
-                            symbolStack.push_back(rhs[i]);
+                        ParseNode& child = tree->_nodes[firstNode + i];
+                        child._symbol = table._rhsSymbols[re - 1 - i];
+                        child._production = -1;
+                        child._length = 0;
+                        child._parent = parent;
+                        child._childCount = 0;
+                        tree->_children[firstChild + i] = firstNode + i;
                     }
-                    std::cout << count++ << "\t\t";
-                    for(auto& c : symbolStack)
-                        std::cout << c;
-                    std::cout << "\t\t";
-                    for(int i = idx; i < str.size(); ++i)
-                        std::cout << str[i];
-                    std::cout << "\t\t" << predictTable[row][col] << std::endl;
+                    ParseNode& node = tree->_nodes[parent];
+                    node._production = k;
+                    node._firstChild = firstChild;
+                    node._childCount = re - rb;
+                    for(int i = rb; i < re; ++i)
+                        nodes[top + (i - rb)] = firstNode + (re - 1 - i);
                 }
+                // 右部已经逆序存放, 空串对应空区间不入栈
+                for(int i = rb; i < re; ++i)
+                    stack[top++] = table._rhsSymbols[i];
+                if(derivation)
+                    derivation->push_back(k);
+                if(level == TRACE_FULL)
+                    printStep(out, count++, stack, top, str, idx, table, k);
+                else if(level == TRACE_DERIVATION)
+                    out << table._productions[k] << '\n';
             }
-
         }
-
     }
 
-    void printSet(const std::map<char, std::set<char>>& Set, const std::string& tag)
+    // 对词法分析器的单词流做LL1分析, 不需要先把整个源程序变成单词序列或字符串
+    // 只保存当前向前看的一个单词, 除分析栈外内存占用与源程序长度无关
+    // 剩余输入事先不知道, TRACE_FULL按TRACE_DERIVATION处理
+    bool LL1Parse(TokenStream& tokens, const PredictTable& table,
+                  std::vector<int16_t>* derivation = nullptr, TraceLevel level = TRACE_NONE)
     {
-        for(const auto& p : Set)
+        const int T = table._numTerminals;
+        int16_t* stack = _symbolStack.data();
+        int top = 0;
+        stack[top++] = table._endMarker;
+        stack[top++] = table._startSymbol;
+        TraceSink out(std::cout);
+        if(level != TRACE_NONE)
+            out << "LL1推导序列:" << '\n';
+        int cur = tokens.next();
+        while(1)
         {
-            if(!isTerminal(p.first, grammar) && p.first != '&')
+            int X = stack[top - 1];
+            if(X == table._endMarker && cur == table._endMarker)
+                return true;
+            if(cur < 0)
             {
-                std::cout << tag << "(" << p.first << ")={";
+                if(level != TRACE_NONE)
+                    out << "Error: 第" << tokens.line() << "行的单词" << tokens.current()._value << "不是文法的终结符" << '\n';
+                return false;
+            }
+            if(X < T)
+            {
+                if(X != cur)
+                {
+                    if(level != TRACE_NONE)
+                        out << "Error: 无法匹配," << "当前栈顶" << table._symbols[X] << "第" << tokens.line() << "行的单词" << tokens.current()._value << '\n';
+                    return false;
+                }
+                --top;
+                cur = tokens.next();
+            }
+            else
+            {
+                // 单词流只保留一个向前看单词, 冲突格取LL1下保留的产生式
+                int k = table.predictLL1(X, cur);
+                if(k < 0)
+                {
+                    if(level != TRACE_NONE)
+                        out << "Error: 无法匹配," << "当前栈顶" << table._symbols[X] << "第" << tokens.line() << "行的单词" << tokens.current()._value << '\n';
+                    return false;
+                }
+                --top;
+                if(top + table._maxRhsLength > _symbolStack.size())
+                {
+                    _symbolStack.resize(_symbolStack.size() * 2 + table._maxRhsLength);
+                    stack = _symbolStack.data();
+                }
+                for(int i = table._rhsBegin[k]; i < table._rhsBegin[k + 1]; ++i)
+                    stack[top++] = table._rhsSymbols[i];
+                if(derivation)
+                    derivation->push_back(k);
+                if(level != TRACE_NONE)
+                    out << table._productions[k] << '\n';
+            }
+        }
+    }
+
+    // 输出预测分析表中的冲突, 没有冲突时不输出
+    void printConflicts(const PredictTable& predictTable, std::ostream& os)
+    {
+        for(const auto& d : predictTable._decisions)
+        {
+            os << "冲突: M[" << predictTable._symbols[d._nonTerminal] << ", " << predictTable._symbols[d._terminal] << "] = ";
+            for(int a = 0; a < d._alternatives.size(); ++a)
+                os << (a ? " / " : "") << predictTable._productions[d._alternatives[a]];
+            os << ", 分析时向前看多个符号选择, 有歧义时取" << predictTable._productions[d._default] << std::endl;
+        }
+        if(!predictTable._decisions.empty())
+            os << "文法不是LL1文法, 共" << predictTable._decisions.size() << "处冲突, 用自适应预测分析" << std::endl;
+    }
+
+    // 缩进打印语法树, 终结符结点后面给出它在输入串中的位置
+    void printParseTree(const ParseTree& tree, const PredictTable& table, const std::string& str)
+    {
+        if(tree._root < 0)
+            return;
+        std::cout << "语法树:" << std::endl;
+        // 显式栈代替递归, 避免长句子的深层树导致栈溢出
+        // 先序遍历按输入顺序经过各个结点, 已经过的终结符个数就是当前结点的起点
+        int32_t pos = 0;
+        std::vector<std::pair<int32_t, int>> st;
+        st.push_back({tree._root, 0});
+        while(!st.empty())
+        {
+            int32_t i = st.back().first;
+            int depth = st.back().second;
+            st.pop_back();
+            const ParseNode& node = tree._nodes[i];
+            std::cout << std::string(depth * 2, ' ') << table._symbols[node._symbol];
+            if(node._production >= 0)
+            {
+                std::cout << "\t" << table._productions[node._production];
+                if(node._childCount == 0)
+                    std::cout << " [" << pos << "]";
+            }
+            else
+            {
+                std::cout << "\t[" << pos << "] " << str[pos];
+                pos += node._length;
+            }
+            std::cout << std::endl;
+            for(int c = node._childCount - 1; c >= 0; --c)
+                st.push_back({tree._children[node._firstChild + c], depth + 1});
+        }
+    }
+
+    void printSet(const std::map<char, std::set<char>>& Set, const std::string& tag)
+    {
+        for(const auto& p : Set)
+        {
+            if(!grammar.isTerminal(p.first) && p.first != '&')
+            {
+                std::cout << tag << "(" << p.first << ")={";
                 for(const auto& c : p.second)
                     std::cout << " " << c;
                 std::cout << " }" << std::endl;
@@ -438,24 +1132,546 @@ public:
         for(auto& c : g._terminalSymbols)
             std::cout << "\t\t" << c;
         std::cout << std::endl;
-        for(int i = 0; i < predictTable.size(); ++i)
+        for(int i = 0; i < predictTable._numNonTerminals; ++i)
         {
             std::cout << g._nonTerminalSymbols[i];
-            for(int j = 0; j < predictTable[i].size(); ++j)
+            for(int j = 0; j < predictTable._numTerminals; ++j)
             {
-                if(predictTable[i][j]._lhs == '\0')
+                int k = predictTable._cells[i * predictTable._numTerminals + j];
+                if(k < -1)
+                {
+                    // 冲突格列出所有候选
+                    std::cout << "\t\t";
+                    const auto& alts = predictTable._decisions[-k - 2]._alternatives;
+                    for(int a = 0; a < alts.size(); ++a)
+                        std::cout << (a ? "/" : "") << predictTable._productions[alts[a]];
+                }
+                else if(k < 0)
                     std::cout << "\t\t" << "err";
                 else
-                    std::cout << "\t\t" << predictTable[i][j];
+                    std::cout << "\t\t" << predictTable._productions[k];
             }
             std::cout << std::endl;
         }
     }
 };
 
-void init()
+// 由文法构造预测分析表, 构造完成后只读, 可以在多个线程之间共享
+PredictTable buildPredictTable(const Grammar& g)
+{
+    LL1Parser parser;
+    GrammarAnalysis analysis(g);
+    PredictTable predictTable = parser.constructPredictTable(g, analysis);
+    parser.printConflicts(predictTable, std::cerr);
+    return predictTable;
+}
+
+// 批量LL1分析
+// 固定数量的工作线程共享同一张只读的预测分析表, 每个线程有自己的LL1Parser(即自己的符号栈), 在线程的整个生命周期内复用
+// 一批句子按GRAIN条一块, 工作线程用原子计数器领取, 结果按句子下标写入, 不需要加锁
+class LL1BatchParser
+{
+private:
+    static const size_t GRAIN = 256;
+    const PredictTable& _table;
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _startCv;
+    std::condition_variable _doneCv;
+    // 当前批次
+    const std::string* _batch;
+    size_t _batchSize;
+    char* _results;
+    std::atomic<size_t> _next;
+    // 批次编号, 工作线程据此判断是否有新的批次
+    size_t _generation;
+    int _running;
+    bool _stop;
+
+    void work()
+    {
+        LL1Parser parser;
+        size_t seen = 0;
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _startCv.wait(lock, [&] { return _stop || _generation != seen; });
+                if(_stop)
+                    return;
+                seen = _generation;
+            }
+            while(true)
+            {
+                size_t begin = _next.fetch_add(GRAIN);
+                if(begin >= _batchSize)
+                    break;
+                size_t end = std::min(begin + GRAIN, _batchSize);
+                for(size_t i = begin; i < end; ++i)
+                    _results[i] = parser.LL1Parse(_batch[i], _table);
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(--_running == 0)
+                _doneCv.notify_one();
+        }
+    }
+
+public:
+    LL1BatchParser(const PredictTable& table, int threadCount)
+        : _table(table), _batch(nullptr), _batchSize(0), _results(nullptr), _next(0), _generation(0), _running(0), _stop(false)
+    {
+        if(threadCount <= 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for(int i = 0; i < threadCount; ++i)
+            _workers.push_back(std::thread(&LL1BatchParser::work, this));
+    }
+
+    LL1BatchParser(const LL1BatchParser&) = delete;
+
+    ~LL1BatchParser()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _startCv.notify_all();
+        for(auto& t : _workers)
+            t.join();
+    }
+
+    // 分析sentences[0, n), results[i]表示第i个句子是否分析成功
+    void parse(const std::string* sentences, size_t n, char* results)
+    {
+        if(n == 0)
+            return;
+        std::unique_lock<std::mutex> lock(_mutex);
+        _batch = sentences;
+        _batchSize = n;
+        _results = results;
+        _next = 0;
+        _running = _workers.size();
+        ++_generation;
+        _startCv.notify_all();
+        _doneCv.wait(lock, [&] { return _running == 0; });
+    }
+
+    void parse(const std::vector<std::string>& sentences, std::vector<char>& results)
+    {
+        results.assign(sentences.size(), 0);
+        parse(sentences.data(), sentences.size(), results.data());
+    }
+
+    // 从输入流逐行读取句子, 每攒够chunkSize行分析一批, 内存占用与输入总长度无关
+    // 对每个分析失败的句子调用onReject(行号, 句子), 返回分析成功的句子数
+    size_t parseStream(std::istream& in, const std::function<void(size_t, const std::string&)>& onReject,
+                       size_t chunkSize = 1 << 16)
+    {
+        // chunk中的字符串在各批之间复用, 不再重新分配
+        std::vector<std::string> chunk(chunkSize);
+        std::vector<char> results(chunkSize);
+        size_t lineNo = 0, accepted = 0;
+        while(in)
+        {
+            size_t n = 0;
+            while(n < chunkSize && std::getline(in, chunk[n]))
+                ++n;
+            if(n == 0)
+                break;
+            parse(chunk.data(), n, results.data());
+            for(size_t i = 0; i < n; ++i)
+            {
+                if(results[i])
+                    ++accepted;
+                else
+                    onReject(lineNo + i + 1, chunk[i]);
+            }
+            lineNo += n;
+        }
+        return accepted;
+    }
+};
+
+// 增量LL1分析
+// 保留上一次的语法树, 编辑后先找覆盖编辑区域的最小非终结符结点N: 起点在编辑起点之前, 终点不早于编辑终点,
+// 这样N之前的分析和N结束时看到的向前看字符都没有变, 从N的起点单独重新分析N
+// 新的终点恰好等于旧终点加上长度变化时, 新推导在N之后和原来的推导重新对齐, 替换N即可; 否则换N的父结点再试
+// 重新分析中要展开的非终结符如果在旧树的对应位置有同一符号的子树, 并且它读过的字符(包括结束时的向前看字符)都没有被编辑,
+// LL1分析的结果必然相同, 直接引用旧子树而不再展开
+// 耗时与编辑长度和编辑处到根的深度有关, 与句子总长无关
+// 自适应预测依赖整个分析栈, 有冲突的文法每次都整句重新分析
+class IncrementalParser
 {
-    auto lines = FileRead(ruleFilePath);
+private:
+    const PredictTable& _table;
+    LL1Parser _parser;
+    ParseTree _tree;
+    std::string _text;
+    bool _valid;
+    // 上次整句分析或压缩后的结点数, 无用结点攒到这么多时压缩一次
+    size_t _compactedSize;
+    // 本次编辑: 旧串中[_start, _start + _removed)被换成了_inserted个字符
+    int64_t _start;
+    int64_t _removed;
+    int64_t _inserted;
+    // 重新分析用的栈: 符号, 以及它的结点在孩子表中的位置(-1表示重新分析的根)
+    std::vector<int16_t> _symbolStack;
+    std::vector<int32_t> _slotStack;
+    // 本次引用的旧子树和它的新父结点, 成功后才修改旧结点的父指针
+    std::vector<std::pair<int32_t, int32_t>> _reused;
+    size_t _newNodes;
+
+    // 在旧树中以region为根(起点regionBegin)的子树里找新位置p处可以复用的符号X的子树, 没有返回-1
+    int32_t findReusable(int32_t region, int64_t regionBegin, int16_t X, int64_t p) const
+    {
+        // 新位置换算成旧位置, 新插入的字符上没有旧子树
+        int64_t q;
+        if(p < _start)
+            q = p;
+        else if(p >= _start + _inserted)
+            q = p - _inserted + _removed;
+        else
+            return -1;
+        int32_t cur = region;
+        int64_t curBegin = regionBegin;
+        while(1)
+        {
+            const ParseNode& z = _tree._nodes[cur];
+            int32_t next = -1;
+            int64_t pos = curBegin;
+            for(int c = 0; c < z._childCount; ++c)
+            {
+                int32_t ch = _tree._children[z._firstChild + c];
+                int64_t len = _tree._nodes[ch]._length;
+                if(pos == q && _tree._nodes[ch]._symbol == X)
+                {
+                    // 读过的字符是[q, q + len], 必须整段在编辑区域之前或之后
+                    if(q + len < _start || q >= _start + _removed)
+                        return ch;
+                    return -1;
+                }
+                if(pos <= q && q < pos + len)
+                {
+                    next = ch;
+                    break;
+                }
+                pos += len;
+            }
+            if(next < 0 || _tree._nodes[next]._childCount == 0)
+                return -1;
+            cur = next;
+            curBegin = pos;
+        }
+    }
+
+    // 从旧结点N的起点b开始在新串上单独分析N的符号, 与旧推导对齐时替换N并返回true, 否则撤销本次分配的结点
+    bool reparse(int32_t N, int64_t b)
+    {
+        const int T = _table._numTerminals;
+        const ParseNode old = _tree._nodes[N];
+        const int32_t nodeMark = _tree._nodes.size();
+        const int32_t childMark = _tree._children.size();
+        const int64_t n = _text.size();
+        _reused.clear();
+        int32_t root = _tree.newNode(old._symbol, old._parent);
+        _symbolStack.clear();
+        _slotStack.clear();
+        _symbolStack.push_back(old._symbol);
+        _slotStack.push_back(-1);
+        int64_t p = b;
+        bool ok = true;
+        while(ok && !_symbolStack.empty())
+        {
+            int X = _symbolStack.back();
+            int32_t slot = _slotStack.back();
+            int32_t node = slot < 0 ? root : _tree._children[slot];
+            char ch = p < n ? _text[p] : '#';
+            int cur = _table._terminalOf[(unsigned char)ch];
+            _symbolStack.pop_back();
+            _slotStack.pop_back();
+            if(X < T)
+            {
+                ok = X == cur;
+                _tree._nodes[node]._length = 1;
+                ++p;
+                continue;
+            }
+            if(slot >= 0)
+            {
+                int32_t M = findReusable(N, b, X, p);
+                if(M >= 0)
+                {
+                    _tree._children[slot] = M;
+                    _reused.push_back({M, _tree._nodes[node]._parent});
+                    p += _tree._nodes[M]._length;
+                    continue;
+                }
+            }
+            int k = cur < 0 ? -1 : _table.predict(X, cur);
+            if(k < 0)
+            {
+                ok = false;
+                break;
+            }
+            int rb = _table._rhsBegin[k], re = _table._rhsBegin[k + 1];
+            int32_t firstNode = _tree.allocNodes(re - rb);
+            int32_t firstChild = _tree.allocChildren(re - rb);
+            for(int i = 0; i < re - rb; ++i)
+            {
+                ParseNode& child = _tree._nodes[firstNode + i];
+                child._symbol = _table._rhsSymbols[re - 1 - i];
+                child._production = -1;
+                child._length = 0;
+                child._parent = node;
+                child._childCount = 0;
+                _tree._children[firstChild + i] = firstNode + i;
+            }
+            ParseNode& parent = _tree._nodes[node];
+            parent._production = k;
+            parent._firstChild = firstChild;
+            parent._childCount = re - rb;
+            for(int i = rb; i < re; ++i)
+            {
+                _symbolStack.push_back(_table._rhsSymbols[i]);
+                _slotStack.push_back(firstChild + (re - 1 - i));
+            }
+        }
+        const int64_t delta = _inserted - _removed;
+        if(!ok || p != b + old._length + delta)
+        {
+            _tree._nodes.resize(nodeMark);
+            _tree._children.resize(childMark);
+            return false;
+        }
+        for(const auto& r : _reused)
+            _tree._nodes[r.first]._parent = r.second;
+        _tree.computeLengths(nodeMark);
+        if(old._parent < 0)
+            _tree._root = root;
+        else
+        {
+            const ParseNode& parent = _tree._nodes[old._parent];
+            for(int c = 0; c < parent._childCount; ++c)
+            {
+                if(_tree._children[parent._firstChild + c] == N)
+                    _tree._children[parent._firstChild + c] = root;
+            }
+        }
+        for(int32_t a = old._parent; a >= 0; a = _tree._nodes[a]._parent)
+            _tree._nodes[a]._length += delta;
+        _newNodes = _tree._nodes.size() - nodeMark;
+        return true;
+    }
+
+    bool fullParse()
+    {
+        _valid = _parser.LL1Parse(_text, _table, nullptr, TRACE_NONE, &_tree);
+        _compactedSize = _tree._nodes.size();
+        _newNodes = _tree._nodes.size();
+        return _valid;
+    }
+
+public:
+    explicit IncrementalParser(const PredictTable& table)
+        : _table(table), _valid(false), _compactedSize(0), _start(0), _removed(0), _inserted(0), _newNodes(0) {}
+
+    // 整句分析, 作为之后编辑的基础
+    bool parse(const std::string& text)
+    {
+        _text = text;
+        return fullParse();
+    }
+
+    // 把[start, start + removed)替换为inserted后重新分析, 返回新句子是否合法
+    bool edit(size_t start, size_t removed, const std::string& inserted)
+    {
+        start = std::min(start, _text.size());
+        removed = std::min(removed, _text.size() - start);
+        _text.replace(start, removed, inserted);
+        _start = start;
+        _removed = removed;
+        _inserted = inserted.size();
+        if(!_valid || !_table._decisions.empty())
+            return fullParse();
+        // 从根往下找覆盖编辑区域的结点, 记下路径以便失败时逐层往上
+        std::vector<std::pair<int32_t, int64_t>> path;
+        int32_t cur = _tree._root;
+        int64_t curBegin = 0;
+        if(_start > 0 && _tree._nodes[cur]._length >= _start + _removed)
+            path.push_back({cur, curBegin});
+        while(!path.empty())
+        {
+            const ParseNode& z = _tree._nodes[cur];
+            int64_t pos = curBegin;
+            int32_t next = -1;
+            for(int c = 0; c < z._childCount; ++c)
+            {
+                int32_t ch = _tree._children[z._firstChild + c];
+                int64_t len = _tree._nodes[ch]._length;
+                if(_tree._nodes[ch]._childCount > 0 && pos < _start && pos + len >= _start + _removed)
+                {
+                    next = ch;
+                    break;
+                }
+                pos += len;
+            }
+            if(next < 0)
+                break;
+            cur = next;
+            curBegin = pos;
+            path.push_back({cur, curBegin});
+        }
+        for(int i = (int)path.size() - 1; i >= 0; --i)
+        {
+            if(reparse(path[i].first, path[i].second))
+            {
+                if(_tree._nodes.size() > 2 * _compactedSize + 1024)
+                {
+                    _tree.compact();
+                    _compactedSize = _tree._nodes.size();
+                }
+                return true;
+            }
+        }
+        // 编辑覆盖了句首或者一直到根都对不齐(通常是新句子有错误), 整句重新分析
+        return fullParse();
+    }
+
+    const ParseTree& tree() const
+    {
+        return _tree;
+    }
+    const std::string& text() const
+    {
+        return _text;
+    }
+    // 最近一次分析新建的结点数
+    size_t newNodes() const
+    {
+        return _newNodes;
+    }
+};
+
+// 生成模式: 把预测分析表输出为C++头文件
+// 头文件中是constexpr的表和一个表驱动的分析函数, 使用时不需要读文法文件, 也不需要求First/Follow集合和构造分析表,
+// 表在编译期已知, 编译器可以把查表和分析循环一起内联优化
+void generateParserHeader(const PredictTable& table, const std::string& name, std::ostream& os)
+{
+    auto writeArray = [&](const char* type, const std::string& arrayName, const std::vector<int>& values) {
+        os << "constexpr " << type << " " << arrayName << "[" << std::max<size_t>(values.size(), 1) << "] = {";
+        for(int i = 0; i < values.size(); ++i)
+        {
+            if(i % 16 == 0)
+                os << "\n    ";
+            os << values[i] << ",";
+        }
+        if(values.empty())
+            os << "0";
+        os << "\n};\n";
+    };
+    std::string guard = name;
+    for(auto& c : guard)
+        c = toupper(c);
+    os << "// 由LL1-parser根据文法" << ruleFilePath << "生成, 不要手工修改\n";
+    // 运行时的分析器在冲突格向前看多个符号选择产生式, 生成的分析器只向前看一个符号,
+    // 两者接受的语言可能不同, 在头文件中写明冲突并给出kHasConflicts, 使用方可以用static_assert拒绝
+    if(!table._decisions.empty())
+    {
+        os << "// WARNING: not LL(1), 共" << table._decisions.size() << "处冲突, 生成的分析器在冲突格固定取一个产生式:\n";
+        for(const auto& d : table._decisions)
+        {
+            os << "//   M[" << table._symbols[d._nonTerminal] << ", " << table._symbols[d._terminal] << "] = ";
+            for(int a = 0; a < d._alternatives.size(); ++a)
+                os << (a ? " / " : "") << table._productions[d._alternatives[a]];
+            os << ", 取" << table._productions[d._default] << "\n";
+        }
+    }
+    os << "#ifndef " << guard << "_H\n#define " << guard << "_H\n\n";
+    os << "#include <cstdint>\n#include <cstddef>\n#include <string>\n#include <vector>\n\n";
+    os << "namespace " << name << "\n{\n\n";
+    os << "// 符号编号: 终结符0.." << table._numTerminals - 1 << ", 非终结符" << table._numTerminals
+       << ".." << table._numTerminals + table._numNonTerminals - 1 << "\n";
+    os << "// 产生式:\n";
+    for(int k = 0; k < table._productions.size(); ++k)
+        os << "//   " << k << ": " << table._productions[k] << "\n";
+    os << "constexpr int kNumTerminals = " << table._numTerminals << ";\n";
+    os << "constexpr int kNumNonTerminals = " << table._numNonTerminals << ";\n";
+    os << "constexpr int16_t kStartSymbol = " << table._startSymbol << ";\n";
+    os << "constexpr int16_t kEndMarker = " << table._endMarker << ";\n";
+    os << "constexpr int kMaxRhsLength = " << table._maxRhsLength << ";\n";
+    os << "constexpr bool kHasConflicts = " << (table._decisions.empty() ? "false" : "true") << ";\n";
+    std::vector<int> values(table._terminalOf, table._terminalOf + 256);
+    writeArray("int16_t", "kTerminalOf", values);
+    // 生成的分析器只向前看一个符号, 冲突格取LL1下保留的产生式
+    values.clear();
+    for(int X = table._numTerminals; X < table._numTerminals + table._numNonTerminals; ++X)
+    {
+        for(int t = 0; t < table._numTerminals; ++t)
+            values.push_back(table.predictLL1(X, t));
+    }
+    writeArray("int16_t", "kPredict", values);
+    values.assign(table._rhsSymbols.begin(), table._rhsSymbols.end());
+    writeArray("int16_t", "kRhsSymbols", values);
+    values.assign(table._rhsBegin.begin(), table._rhsBegin.end());
+    writeArray("int32_t", "kRhsBegin", values);
+    os << R"(
+// 分析句子str[0, n), 遇到#或到达末尾时视为输入结束
+// stack为调用方提供的符号栈, 容量不足时扩容; derivation不为空时记录使用的产生式编号
+inline bool parse(const char* str, size_t n, std::vector<int16_t>& stack, std::vector<int16_t>* derivation = nullptr)
+{
+    if(stack.size() < 64)
+        stack.resize(64);
+    int16_t* st = stack.data();
+    size_t top = 0;
+    size_t idx = 0;
+    st[top++] = kEndMarker;
+    st[top++] = kStartSymbol;
+    while(true)
+    {
+        int cur = idx < n ? kTerminalOf[(unsigned char)str[idx]] : kEndMarker;
+        int X = st[top - 1];
+        if(X == kEndMarker && cur == kEndMarker)
+            return true;
+        if(X < kNumTerminals)
+        {
+            if(X != cur)
+                return false;
+            --top;
+            ++idx;
+            continue;
+        }
+        if(cur < 0)
+            return false;
+        int k = kPredict[(X - kNumTerminals) * kNumTerminals + cur];
+        if(k < 0)
+            return false;
+        --top;
+        if(top + kMaxRhsLength > stack.size())
+        {
+            stack.resize(stack.size() * 2 + kMaxRhsLength);
+            st = stack.data();
+        }
+        for(int i = kRhsBegin[k]; i < kRhsBegin[k + 1]; ++i)
+            st[top++] = kRhsSymbols[i];
+        if(derivation)
+            derivation->push_back(k);
+    }
+}
+
+inline bool parse(const std::string& str)
+{
+    thread_local std::vector<int16_t> stack;
+    return parse(str.data(), str.size(), stack);
+}
+
+)";
+    os << "} // namespace " << name << "\n\n#endif\n";
+}
+
+// 读取文法文件
+Grammar loadGrammar(const std::string& filepath)
+{
+    Grammar g;
+    auto lines = FileRead(filepath);
     int flag = 0;
     for(auto& line : lines)
     {
@@ -464,42 +1680,455 @@ void init()
         {
             if(!flag)
             {
-                grammar._startSymbol = line[0];
+                g._startSymbol = line[0];
                 for(auto& c : line)
-                    grammar._nonTerminalSymbols.push_back(c);
+                    g._nonTerminalSymbols.push_back(c);
                 flag = 1;
             }
             else
             {
                 for(auto& c : line)
-                        grammar._terminalSymbols.push_back(c);
+                        g._terminalSymbols.push_back(c);
             }
         }
         else
         {
             char lhs = line[0];
             std::string rhs = line.substr(pos + 2);
-            grammar._productionRules.push_back({lhs, rhs});
+            g._productionRules.push_back({lhs, rhs});
         }
     }
     // 结束符号 # 当作终结符加入到终结符集合中
-    grammar._terminalSymbols.push_back('#');
+    g._terminalSymbols.push_back('#');
+    return g;
+}
+
+// 文法变换: 消除左递归、提取左公因子, 让表达式这类左递归文法也能构造LL1预测分析表
+// 新引入的非终结符从文法没有用过的字符中挑选, 优先用大写字母, 紧跟在产生它的非终结符后面
+// 文法没有变化时原样返回, 产生式的顺序不变
+class GrammarTransformer
+{
+private:
+    Grammar _g;
+    std::ostream* _log;
+    bool _changed;
+    bool _used[256];
+    // 非终结符的顺序, 以及每个非终结符的全部右部, 空串用""表示
+    std::vector<char> _order;
+    std::map<char, std::vector<std::string>> _rules;
+
+    bool isNonTerminal(char c) const
+    {
+        return _rules.count(c) > 0;
+    }
+
+    // 引入一个新的非终结符, 放在from后面
+    char newNonTerminal(char from)
+    {
+        static const std::string candidates = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+        for(auto c : candidates)
+        {
+            if(_used[(unsigned char)c])
+                continue;
+            _used[(unsigned char)c] = true;
+            _order.insert(std::find(_order.begin(), _order.end(), from) + 1, c);
+            _rules[c];
+            return c;
+        }
+        std::cerr << "Error: 没有可用的字符作为新的非终结符!" << std::endl;
+        exit(-1);
+    }
+
+    // from能否经过若干步最左推导(只看右部第一个符号)得到以to开头的串
+    bool leftReaches(char from, char to) const
+    {
+        std::set<char> visited;
+        std::vector<char> work(1, from);
+        while(!work.empty())
+        {
+            char X = work.back();
+            work.pop_back();
+            for(const auto& rhs : _rules.at(X))
+            {
+                if(rhs.empty() || !isNonTerminal(rhs[0]))
+                    continue;
+                if(rhs[0] == to)
+                    return true;
+                if(visited.insert(rhs[0]).second)
+                    work.push_back(rhs[0]);
+            }
+        }
+        return false;
+    }
+
+    // A->Aα1|...|Aαm|β1|...|βn 改写为 A->β1A'|...|βnA', A'->α1A'|...|αmA'|&
+    void eliminateDirect(char A)
+    {
+        std::vector<std::string> alpha, beta;
+        bool recursive = false;
+        for(const auto& rhs : _rules[A])
+        {
+            if(!rhs.empty() && rhs[0] == A)
+            {
+                recursive = true;
+                if(rhs.size() > 1)  // A->A没有意义, 直接丢掉
+                    alpha.push_back(rhs.substr(1));
+            }
+            else
+                beta.push_back(rhs);
+        }
+        if(!recursive)
+            return;
+        if(beta.empty())
+        {
+            std::cerr << "Error: " << A << "的产生式都是左递归, 无法消除!" << std::endl;
+            exit(-1);
+        }
+        _changed = true;
+        if(alpha.empty())
+        {
+            _rules[A] = beta;
+            return;
+        }
+        char R = newNonTerminal(A);
+        if(_log)
+            *_log << "消除" << A << "的直接左递归, 引入非终结符" << R << std::endl;
+        _rules[A].clear();
+        for(const auto& b : beta)
+            _rules[A].push_back(b + R);
+        for(const auto& a : alpha)
+            _rules[R].push_back(a + R);
+        _rules[R].push_back("");
+    }
+
+    // 按非终结符的顺序把排在前面、能推出Ai的Aj代入Ai->Ajγ, 间接左递归都变成直接左递归再消除
+    // 只代入会造成左递归的Aj, 没有左递归的文法保持原样
+    void eliminateLeftRecursion()
+    {
+        std::vector<char> original = _order;
+        for(int i = 0; i < original.size(); ++i)
+        {
+            char Ai = original[i];
+            bool substituted = true;
+            while(substituted)
+            {
+                substituted = false;
+                for(int j = 0; j < i; ++j)
+                {
+                    char Aj = original[j];
+                    auto& rules = _rules[Ai];
+                    bool starts = false;
+                    for(const auto& rhs : rules)
+                        starts |= !rhs.empty() && rhs[0] == Aj;
+                    if(!starts || !leftReaches(Aj, Ai))
+                        continue;
+                    std::vector<std::string> replaced;
+                    for(const auto& rhs : rules)
+                    {
+                        if(!rhs.empty() && rhs[0] == Aj)
+                        {
+                            for(const auto& delta : _rules[Aj])
+                                replaced.push_back(delta + rhs.substr(1));
+                        }
+                        else
+                            replaced.push_back(rhs);
+                    }
+                    rules = replaced;
+                    substituted = _changed = true;
+                    if(_log)
+                        *_log << "把" << Aj << "的产生式代入" << Ai << ", 消除间接左递归" << std::endl;
+                }
+            }
+            eliminateDirect(Ai);
+        }
+    }
+
+    // A->αβ1|...|αβn|γ 改写为 A->αA'|γ, A'->β1|...|βn, 反复进行直到没有公共前缀
+    void leftFactor()
+    {
+        for(int idx = 0; idx < _order.size(); ++idx)
+        {
+            char A = _order[idx];
+            while(1)
+            {
+                auto& rules = _rules[A];
+                // 找第一组首符号相同的右部
+                int first = -1;
+                std::vector<int> group;
+                for(int p = 0; p < rules.size() && group.size() < 2; ++p)
+                {
+                    if(rules[p].empty())
+                        continue;
+                    group.clear();
+                    group.push_back(p);
+                    for(int q = p + 1; q < rules.size(); ++q)
+                    {
+                        if(!rules[q].empty() && rules[q][0] == rules[p][0])
+                            group.push_back(q);
+                    }
+                    first = p;
+                }
+                if(group.size() < 2)
+                    break;
+                // 组内最长公共前缀
+                std::string prefix = rules[first];
+                for(auto q : group)
+                {
+                    int len = 0;
+                    while(len < prefix.size() && len < rules[q].size() && prefix[len] == rules[q][len])
+                        ++len;
+                    prefix.resize(len);
+                }
+                _changed = true;
+                char R = newNonTerminal(A);
+                if(_log)
+                    *_log << "提取" << A << "的左公因子" << prefix << ", 引入非终结符" << R << std::endl;
+                std::vector<std::string> rest;
+                for(int p = 0; p < rules.size(); ++p)
+                {
+                    if(std::find(group.begin(), group.end(), p) != group.end())
+                    {
+                        _rules[R].push_back(rules[p].substr(prefix.size()));
+                        if(p == first)
+                            rest.push_back(prefix + R);
+                    }
+                    else
+                        rest.push_back(rules[p]);
+                }
+                rules = rest;
+            }
+        }
+    }
+
+public:
+    GrammarTransformer(const Grammar& g, std::ostream* log)
+        : _g(g), _log(log), _changed(false), _order(g._nonTerminalSymbols)
+    {
+        std::fill(_used, _used + 256, false);
+        _used[(unsigned char)'&'] = _used[(unsigned char)'#'] = true;
+        for(auto c : g._nonTerminalSymbols)
+        {
+            _used[(unsigned char)c] = true;
+            _rules[c];
+        }
+        for(auto c : g._terminalSymbols)
+            _used[(unsigned char)c] = true;
+        for(const auto& p : g._productionRules)
+        {
+            std::string rhs;
+            for(auto c : p._rhs)
+            {
+                _used[(unsigned char)c] = true;
+                if(c != '&')
+                    rhs += c;
+            }
+            _rules[p._lhs].push_back(rhs);
+        }
+    }
+
+    Grammar transform()
+    {
+        eliminateLeftRecursion();
+        leftFactor();
+        if(!_changed)
+            return _g;
+        Grammar g = _g;
+        g._nonTerminalSymbols = _order;
+        g._productionRules.clear();
+        for(auto A : _order)
+        {
+            for(const auto& rhs : _rules[A])
+                g._productionRules.push_back({A, rhs.empty() ? "&" : rhs});
+        }
+        return g;
+    }
+};
+
+// 构造预测分析表之前先做文法变换, log不为空时输出做了哪些变换
+Grammar toLL1Grammar(const Grammar& g, std::ostream* log = nullptr)
+{
+    return GrammarTransformer(g, log).transform();
+}
+
+void init()
+{
+    grammar = toLL1Grammar(loadGrammar(ruleFilePath), &std::cout);
     std::cout << grammar;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+    // -f <ruleFilePath> 指定文法文件, -s <sentence> 指定待分析的句子
+    // -t none|derivation|full 指定分析过程的输出级别, 默认输出完整的分析表格
+    // -p 分析成功后打印语法树
+    // -b <file> 批量分析文件中的每一行(-表示标准输入), 只输出分析失败的行; -j <n> 指定线程数, 默认为CPU核数
+    // -g <header> 生成该文法的分析器头文件, 命名空间为头文件名(去掉扩展名)
+    // -c <srcFile> 用lab1的词法分析器边读源程序边分析, 标识符和常数对应终结符n
+    // -i 先分析-s给出的句子, 再从标准输入逐行读入编辑"起点 删除长度 [插入串]"做增量分析
+    TraceLevel level = TRACE_FULL;
+    std::string headerFile;
+    std::string srcFile;
+    bool printTree = false;
+    bool incremental = false;
+    std::string batchFile;
+    int threadCount = 0;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if(arg == "-p")
+            printTree = true;
+        else if(arg == "-i")
+            incremental = true;
+        else if(arg == "-f" && i + 1 < argc)
+            ruleFilePath = argv[++i];
+        else if(arg == "-s" && i + 1 < argc)
+            sentence = argv[++i];
+        else if(arg == "-b" && i + 1 < argc)
+            batchFile = argv[++i];
+        else if(arg == "-g" && i + 1 < argc)
+            headerFile = argv[++i];
+        else if(arg == "-c" && i + 1 < argc)
+            srcFile = argv[++i];
+        else if(arg == "-j" && i + 1 < argc)
+            threadCount = std::atoi(argv[++i]);
+        else if(arg == "-t" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if(name == "none")
+                level = TRACE_NONE;
+            else if(name == "derivation")
+                level = TRACE_DERIVATION;
+            else if(name == "full")
+                level = TRACE_FULL;
+            else
+            {
+                std::cerr << "Error: 未知的输出级别" << name << std::endl;
+                exit(-1);
+            }
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [-f ruleFile] [-s sentence] [-t none|derivation|full] [-p]" << std::endl;
+            std::cerr << "       " << argv[0] << " [-f ruleFile] -b sentenceFile [-j threads]" << std::endl;
+            std::cerr << "       " << argv[0] << " [-f ruleFile] -g header.h" << std::endl;
+            std::cerr << "       " << argv[0] << " [-f ruleFile] -c srcFile [-t none|derivation]" << std::endl;
+            std::cerr << "       " << argv[0] << " [-f ruleFile] [-s sentence] -i [-p]" << std::endl;
+            exit(-1);
+        }
+    }
+    if(!headerFile.empty())
+    {
+        // 命名空间取头文件名去掉目录和扩展名, 非字母数字的字符替换为下划线
+        std::string name = headerFile.substr(headerFile.find_last_of('/') + 1);
+        name = name.substr(0, name.find('.'));
+        for(auto& c : name)
+        {
+            if(!isalnum((unsigned char)c))
+                c = '_';
+        }
+        if(name.empty() || isdigit((unsigned char)name[0]))
+            name = "ll1_" + name;
+        grammar = toLL1Grammar(loadGrammar(ruleFilePath));
+        std::ofstream fout(headerFile, std::ios::out | std::ios::trunc);
+        if(!fout.is_open())
+        {
+            std::cerr << "Error: open file failed!" << std::endl;
+            exit(-1);
+        }
+        PredictTable table = buildPredictTable(grammar);
+        generateParserHeader(table, name, fout);
+        std::cout << "已生成" << headerFile << ", 命名空间" << name << std::endl;
+        if(!table._decisions.empty())
+            std::cerr << "Warning: 文法不是LL1文法, 共" << table._decisions.size()
+                      << "处冲突, 生成的分析器只向前看一个符号, 冲突格固定取一个产生式, 接受的语言可能与-s分析的不同" << std::endl;
+        return 0;
+    }
+    if(!srcFile.empty())
+    {
+        grammar = toLL1Grammar(loadGrammar(ruleFilePath));
+        const PredictTable predictTable = buildPredictTable(grammar);
+        Tokenizer tokenizer(catagoryFilePath);
+        tokenizer.loadSrcCode(srcFile);
+        TokenStream tokens(tokenizer, predictTable);
+        LL1Parser parser;
+        if(parser.LL1Parse(tokens, predictTable, nullptr, level))
+            std::cout << "对" << srcFile << "LL1分析成功! 共" << tokens.count() << "个单词" << std::endl;
+        else
+            std::cout << "对" << srcFile << ", LL1分析失败!" << std::endl;
+        return 0;
+    }
+    if(incremental)
+    {
+        grammar = toLL1Grammar(loadGrammar(ruleFilePath));
+        const PredictTable predictTable = buildPredictTable(grammar);
+        LL1Parser parser;
+        IncrementalParser incParser(predictTable);
+        bool ok = incParser.parse(sentence);
+        std::cout << incParser.text() << (ok ? " 分析成功" : " 分析失败") << std::endl;
+        std::string line;
+        while(getline(std::cin, line))
+        {
+            std::istringstream in(line);
+            size_t start, removed;
+            std::string inserted;
+            if(!(in >> start >> removed))
+            {
+                std::cerr << "Error: 编辑格式为\"起点 删除长度 [插入串]\"" << std::endl;
+                continue;
+            }
+            in >> inserted;
+            ok = incParser.edit(start, removed, inserted);
+            std::cout << incParser.text() << (ok ? " 分析成功" : " 分析失败")
+                      << ", 新建" << incParser.newNodes() << "个结点" << std::endl;
+            if(ok && printTree)
+                parser.printParseTree(incParser.tree(), predictTable, incParser.text());
+        }
+        return 0;
+    }
+    if(!batchFile.empty())
+    {
+        grammar = toLL1Grammar(loadGrammar(ruleFilePath));
+        const PredictTable predictTable = buildPredictTable(grammar);
+        LL1BatchParser batchParser(predictTable, threadCount);
+        std::ifstream fin;
+        if(batchFile != "-")
+        {
+            fin.open(batchFile, std::ios::in);
+            if(!fin.is_open())
+            {
+                std::cerr << "Error: open file failed!" << std::endl;
+                exit(-1);
+            }
+        }
+        std::istream& in = batchFile == "-" ? std::cin : fin;
+        size_t rejected = 0;
+        size_t accepted = batchParser.parseStream(in, [&](size_t lineNo, const std::string& s) {
+            ++rejected;
+            std::cout << "第" << lineNo << "行分析失败: " << s << '\n';
+        });
+        std::cout << "分析成功" << accepted << "行, 失败" << rejected << "行" << std::endl;
+        return 0;
+    }
     init();
     LL1Parser parser;
-    auto firstSet = parser.calculateFirstSet(grammar);
-    parser.printSet(firstSet, "First");
-    auto followSet = parser.calculateFollowSet(grammar);
-    parser.printSet(followSet, "Follow");
-    auto predictTable = parser.constructPredictTable(grammar);
+    GrammarAnalysis analysis(grammar);
+    parser.printSet(analysis.firstSets(), "First");
+    parser.printSet(analysis.followSets(), "Follow");
+    auto predictTable = parser.constructPredictTable(grammar, analysis);
     parser.printPredictTabel(predictTable, grammar);
-    if(parser.LL1Parse(sentence, grammar))
-        std::cout << "对句子" << sentence <<"LL1分析成功!" << std::endl;
+    parser.printConflicts(predictTable, std::cout);
+    std::vector<int16_t> derivation;
+    ParseTree tree;
+    if(parser.LL1Parse(sentence, predictTable, &derivation, level, printTree ? &tree : nullptr))
+    {
+        std::cout << "对句子" << sentence <<"LL1分析成功! 推导共" << derivation.size() << "步" << std::endl;
+        if(printTree)
+            parser.printParseTree(tree, predictTable, sentence);
+    }
     else
         std::cout << "对句子" << sentence << ", LL1分析失败!" << std::endl;
+    auto stateCounts = predictTable._adaptive->stateCounts();
+    for(int d = 0; d < stateCounts.size(); ++d)
+        std::cout << "决策" << d << "的向前看DFA共" << stateCounts[d] << "个状态" << std::endl;
     return 0;
-}
\ No newline at end of file
+}
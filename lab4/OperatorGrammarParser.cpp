@@ -5,13 +5,65 @@
 #include <map>
 #include <unordered_map>
 #include <set>
-#include <deque>
-#include <stack>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
-// 用于表达式求值的符号栈与数字栈
-std::stack<char> opStack;
-std::stack<int> numStack;
-std::string op = "+-*/";
+// 二元运算符
+const std::string op = "+-*/";
+
+// int的加减乘在unsigned下做再转回int, 溢出时按补码回绕, 与AVX2块运算和JIT生成的代码一致, 不是未定义行为
+template<typename T>
+inline T add(T l, T r) { return l + r; }
+template<>
+inline int add<int>(int l, int r) { return (int)((unsigned)l + (unsigned)r); }
+template<typename T>
+inline T subtract(T l, T r) { return l - r; }
+template<>
+inline int subtract<int>(int l, int r) { return (int)((unsigned)l - (unsigned)r); }
+template<typename T>
+inline T multiply(T l, T r) { return l * r; }
+template<>
+inline int multiply<int>(int l, int r) { return (int)((unsigned)l * (unsigned)r); }
+
+// 整数除以0时结果记为0, 批量求值时一行坏数据不能让整批中止; INT_MIN/-1同样按补码回绕
+template<typename T>
+inline T divide(T l, T r) { return l / r; }
+template<>
+inline int divide<int>(int l, int r) { return r == 0 ? 0 : (r == -1 ? (int)(0u - (unsigned)l) : l / r); }
+
+// 一次分析的状态: 分析栈与用于表达式求值的符号栈、数字栈; 每个线程各用一个
+// 栈的空间按句子长度预留, 同一个上下文反复分析时不再分配内存
+struct EvalContext
+{
+    std::vector<char> _analyseStack;
+    std::vector<char> _opStack;
+    std::vector<int> _numStack;
+    bool _noValue;          // 句子中有变量或不能求值的运算符时只分析, 表达式没有值
+
+    // 开始分析长为length的句子之前清空各栈
+    void reset(size_t length)
+    {
+        _noValue = false;
+        _analyseStack.clear();
+        _opStack.clear();
+        _numStack.clear();
+        _analyseStack.reserve(length + 2);
+        _opStack.reserve(length);
+        _numStack.reserve(length);
+    }
+};
 
 // 规则A->&， &表示空串
 struct productionRule
@@ -36,78 +88,110 @@ struct Grammar
     std::vector<char> _nonTerminalSymbols;// 非终结符
     std::vector<char> _terminalSymbols;// 终结符
     std::vector<productionRule> _productionRules;// 产生式规则集合
-    // 等价非终结符集合
-    std::set<char> _closure;
+    // 骨架中代替非终结符的字符
+    static const char WILDCARD = '\0';
+    // 字符 -> 它在句柄骨架中的字符; 骨架 -> 产生式左部, 骨架相同时取先出现的产生式; 由buildHandleTable建立
+    char _skeleton[256];
+    std::unordered_map<std::string, char> _handleTable;
+    // 字符 -> 终结符下标, 数字和变量都当作i, -1表示不是终结符; 字符 -> 非终结符下标, -1表示不是非终结符
+    // 读入文法后由buildTerminalIndex建立
+    int16_t _terminalIndex[256];
+    int16_t _nonTerminalIndex[256];
+
+    void buildTerminalIndex()
+    {
+        std::fill(_nonTerminalIndex, _nonTerminalIndex + 256, -1);
+        for(int i = 0; i < _nonTerminalSymbols.size(); ++i)
+            _nonTerminalIndex[(unsigned char)_nonTerminalSymbols[i]] = i;
+        std::fill(_terminalIndex, _terminalIndex + 256, -1);
+        for(int i = 0; i < _terminalSymbols.size(); ++i)
+            _terminalIndex[(unsigned char)_terminalSymbols[i]] = i;
+        for(char c = '0'; c <= '9'; ++c)
+            _terminalIndex[(unsigned char)c] = _terminalIndex[(unsigned char)'i'];
+        for(int c = 0; c < 256; ++c)
+        {
+            if(isVariable(c))
+                _terminalIndex[c] = _terminalIndex[(unsigned char)'i'];
+        }
+    }
+    void buildHandleTable()
+    {
+        for(int c = 0; c < 256; ++c)
+        {
+            if(isNonTerminal(c))
+                _skeleton[c] = WILDCARD;
+            else if(isOperand(c))
+                _skeleton[c] = 'i';
+            else
+                _skeleton[c] = c;
+        }
+        _handleTable.clear();
+        for(auto& p : _productionRules)
+        {
+            std::string key(p._rhs.size(), WILDCARD);
+            for(int i = 0; i < p._rhs.size(); ++i)
+                key[i] = _skeleton[(unsigned char)p._rhs[i]];
+            _handleTable.emplace(key, p._lhs);
+        }
+    }
+    // 句子中不是文法符号的字母是变量, 字母i本身也看作名为i的变量; 只有编译成字节码时才能给变量赋值
+    inline bool isVariable(char c) const
+    {
+        if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+            return false;
+        if(c == 'i')
+            return true;
+        return !isNonTerminal(c) && std::find(_terminalSymbols.begin(), _terminalSymbols.end(), c) == _terminalSymbols.end();
+    }
+    // 数字和变量都是操作数, 按产生式F->i规约
+    inline bool isOperand(char c) const
+    {
+        return (c >= '0' && c <= '9') || isVariable(c);
+    }
     inline bool isNonTerminal(char c) const
     {
-        return std::find(_nonTerminalSymbols.begin(), _nonTerminalSymbols.end(), c) != _nonTerminalSymbols.end();
+        return _nonTerminalIndex[(unsigned char)c] >= 0;
     }
 
     inline bool isTerminal(char c) const
     {
-        if(c >= '0' && c <= '9')
+        if(isOperand(c))
             return true;
         return std::find(_terminalSymbols.begin(), _terminalSymbols.end(), c) != _terminalSymbols.end();
     }
 
-    char reduction(const std::string &rhs) const
+    // 查找右部与rhs匹配的产生式, 返回其左部, 找不到返回'\0'; 只匹配不求值
+    // 算符优先分析只看句柄中终结符的位置, 句柄先化成骨架(非终结符->WILDCARD, 数字和变量->i)再查一次哈希表
+    char match(const std::string &rhs) const
     {
-        if(rhs.size() == 1 && rhs[0] >= '0' && rhs[0] <= '9')
-            return 'F';
-        for(auto& p : _productionRules)
+        std::string key(rhs.size(), WILDCARD);
+        for(int i = 0; i < rhs.size(); ++i)
+            key[i] = _skeleton[(unsigned char)rhs[i]];
+        auto it = _handleTable.find(key);
+        return it == _handleTable.end() ? '\0' : it->second;
+    }
+
+    // 规约并求值: 按二元运算的产生式规约时从ctx的符号栈、数字栈取出运算符和两个操作数, 结果压回数字栈
+    char reduction(const std::string &rhs, EvalContext& ctx) const
+    {
+        char lhs = match(rhs);
+        if(lhs != '\0' && rhs.size() == 3 && op.find(rhs[1]) != std::string::npos && ctx._numStack.size() >= 2)
         {
-            bool flag = true;
-            if(p._rhs == rhs)
-                return p._lhs;
-            else if(p._rhs.size() == rhs.size())
-            {
-                for(int i = 0; i < rhs.size(); ++i)
-                {
-                    if(p._rhs[i] == rhs[i])
-                        continue;
-                    else
-                    {
-                        if(isNonTerminal(p._rhs[i]) && isNonTerminal(rhs[i]))
-                        {
-                            if(_closure.find(p._rhs[i]) != _closure.end() && _closure.find(rhs[i]) != _closure.end())
-                                continue;
-                            else
-                            {
-                                flag = false;
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            flag = false;
-                            break;
-                        }
-                    }
-                }
-                if(flag)
-                {
-                    if(rhs.size() == 3 && op.find(rhs[1]) != std::string::npos)
-                    {
-                        char Operator = opStack.top();
-                        opStack.pop();
-                        int r = numStack.top();
-                        numStack.pop();
-                        int l = numStack.top();
-                        numStack.pop();
-                        if(Operator == '+')
-                            numStack.push(l + r);
-                        else if(Operator == '-')
-                            numStack.push(l - r);
-                        else if(Operator == '*')
-                            numStack.push(l * r);
-                        else if(Operator == '/')
-                            numStack.push(l / r);
-                    }
-                    return p._lhs;
-                }
-            }
+            char Operator = ctx._opStack.back();
+            ctx._opStack.pop_back();
+            int r = ctx._numStack.back();
+            ctx._numStack.pop_back();
+            int& l = ctx._numStack.back();
+            if(Operator == '+')
+                l = add(l, r);
+            else if(Operator == '-')
+                l = subtract(l, r);
+            else if(Operator == '*')
+                l = multiply(l, r);
+            else if(Operator == '/')
+                l = divide(l, r);
         }
-        return '\0';
+        return lhs;
     }
 
     friend std::ostream& operator<<(std::ostream& os, const Grammar& g)
@@ -129,30 +213,18 @@ struct Grammar
     }
     inline int getIndexOfNonTerminal(char c) const
     {
-        for(int i = 0; i < _nonTerminalSymbols.size(); ++i)
-        {
-            if(_nonTerminalSymbols[i] == c)
-                return i;
-        }
-        return -1;
+        return _nonTerminalIndex[(unsigned char)c];
     }
     inline int getIndexOfTerminal(char c) const
     {
-        if(c >= '0' && c <= '9')
-            return std::find(_terminalSymbols.begin(), _terminalSymbols.end(), 'i') - _terminalSymbols.begin();
-        for(int i = 0; i < _terminalSymbols.size(); ++i)
-        {
-            if(_terminalSymbols[i] == c)
-                return i;
-        }
-        return -1;
+        return _terminalIndex[(unsigned char)c];
     }
 
 } grammar;
 
 // // const std::string sentence = "(i+i)*i-i/i#";
-const std::string ruleFilePath = "./operatorgrammar.txt";
-const std::string sentence = "(1+2)*3-4/2#";
+std::string ruleFilePath = "./operatorgrammar.txt";
+std::string sentence = "(1+2)*3-4/2#";
 
 // const std::string ruleFilePath = "./test.txt";
 // const std::string sentence = "(1+2)*3-4/2#";
@@ -161,6 +233,660 @@ const std::string sentence = "(1+2)*3-4/2#";
 
 typedef std::vector<std::vector<char>> PriorityTable;
 
+// 位集合的一行, 第k位在第k/64个字的第k%64位
+typedef std::vector<uint64_t> BitRow;
+
+inline bool testBit(const BitRow& row, int k)
+{
+    return row[k >> 6] >> (k & 63) & 1;
+}
+inline void setBit(BitRow& row, int k)
+{
+    row[k >> 6] |= 1ULL << (k & 63);
+}
+inline void orInto(BitRow& dst, const BitRow& src)
+{
+    for(int i = 0; i < dst.size(); ++i)
+        dst[i] |= src[i];
+}
+
+// 优先函数: 用f(a)与g(b)的大小代替优先级表中a与b的关系, f(a)<g(b)即a<b, 相等即a=b, 大于即a>b
+// 两个长度为终结符个数的数组代替|T|x|T|的表; 代价是表中空白(出错)的格子也会比较出某种关系, 错误要到规约时才能发现
+struct PrecedenceFunctions
+{
+    std::vector<int> _f;
+    std::vector<int> _g;
+
+    inline char relation(int a, int b) const
+    {
+        return _f[a] < _g[b] ? '<' : (_f[a] == _g[b] ? '=' : '>');
+    }
+};
+
+// 表达式字节码: 规约顺序就是逆波兰式的顺序, 操作数压栈, 二元运算弹出两个操作数再压入结果
+enum OpCode : uint8_t { OP_CONST, OP_LOAD, OP_ADD, OP_SUB, OP_MUL, OP_DIV };
+
+struct Instruction
+{
+    OpCode _op;
+    int32_t _arg;   // OP_CONST为常量值, OP_LOAD为变量槽位
+};
+
+// 列式求值每次处理的行数, 每个中间结果占一个这么大的缓冲区
+const size_t BLOCK_SIZE = 1024;
+
+// 块运算 out[i] = l[i] op r[i], out可以与l或r相同; 标量版本在不支持AVX2的机器上使用
+template<typename T>
+void blockBinaryScalar(OpCode code, T* out, const T* l, const T* r, size_t n)
+{
+    switch(code)
+    {
+    case OP_ADD: for(size_t i = 0; i < n; ++i) out[i] = add(l[i], r[i]); break;
+    case OP_SUB: for(size_t i = 0; i < n; ++i) out[i] = subtract(l[i], r[i]); break;
+    case OP_MUL: for(size_t i = 0; i < n; ++i) out[i] = multiply(l[i], r[i]); break;
+    case OP_DIV: for(size_t i = 0; i < n; ++i) out[i] = divide(l[i], r[i]); break;
+    default: break;
+    }
+}
+
+#if defined(__x86_64__)
+inline bool cpuHasAVX2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+// AVX2一次算8个int; 没有整数除法指令, 除法仍走标量
+__attribute__((target("avx2")))
+void blockBinaryAVX2(OpCode code, int* out, const int* l, const int* r, size_t n)
+{
+    size_t i = 0;
+    switch(code)
+    {
+    case OP_ADD:
+        for(; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(l + i)), _mm256_loadu_si256((const __m256i*)(r + i))));
+        break;
+    case OP_SUB:
+        for(; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(l + i)), _mm256_loadu_si256((const __m256i*)(r + i))));
+        break;
+    case OP_MUL:
+        for(; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(l + i)), _mm256_loadu_si256((const __m256i*)(r + i))));
+        break;
+    default:
+        break;
+    }
+    blockBinaryScalar(code, out + i, l + i, r + i, n - i);
+}
+
+// AVX2一次算4个double
+__attribute__((target("avx2")))
+void blockBinaryAVX2(OpCode code, double* out, const double* l, const double* r, size_t n)
+{
+    size_t i = 0;
+    switch(code)
+    {
+    case OP_ADD:
+        for(; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(l + i), _mm256_loadu_pd(r + i)));
+        break;
+    case OP_SUB:
+        for(; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(l + i), _mm256_loadu_pd(r + i)));
+        break;
+    case OP_MUL:
+        for(; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(l + i), _mm256_loadu_pd(r + i)));
+        break;
+    case OP_DIV:
+        for(; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_loadu_pd(l + i), _mm256_loadu_pd(r + i)));
+        break;
+    default:
+        break;
+    }
+    blockBinaryScalar(code, out + i, l + i, r + i, n - i);
+}
+#else
+inline bool cpuHasAVX2()
+{
+    return false;
+}
+template<typename T>
+void blockBinaryAVX2(OpCode code, T* out, const T* l, const T* r, size_t n)
+{
+    blockBinaryScalar(code, out, l, r, n);
+}
+#endif
+
+// 编译一次, 对每一组变量取值反复求值
+struct Program
+{
+    std::vector<Instruction> _code;
+    std::string _variables;     // 槽位 -> 变量名, 按在句子中首次出现的顺序编号
+    int _maxDepth;              // 求值时栈的最大深度
+
+    Program() : _maxDepth(0) {}
+
+    // slots是一组变量取值, stack至少有_maxDepth个元素
+    template<typename T>
+    T run(const T* slots, T* stack) const
+    {
+        T* top = stack - 1;
+        for(const Instruction *pc = _code.data(), *end = pc + _code.size(); pc != end; ++pc)
+        {
+            switch(pc->_op)
+            {
+            case OP_CONST: *++top = (T)pc->_arg; break;
+            case OP_LOAD:  *++top = slots[pc->_arg]; break;
+            case OP_ADD:   --top; *top = add(*top, top[1]); break;
+            case OP_SUB:   --top; *top = subtract(*top, top[1]); break;
+            case OP_MUL:   --top; *top = multiply(*top, top[1]); break;
+            case OP_DIV:   --top; *top = divide(*top, top[1]); break;
+            }
+        }
+        return *top;
+    }
+
+    // bindings按行存放, 每行_variables.size()个变量取值, 第r行的结果写入results[r]
+    template<typename T>
+    void evaluate(const T* bindings, size_t rows, T* results) const
+    {
+        std::vector<T> stack(std::max(_maxDepth, 1));
+        const size_t width = _variables.size();
+        for(size_t r = 0; r < rows; ++r)
+            results[r] = run(bindings + r * width, stack.data());
+    }
+
+    // 列式求值: columns[slot]是变量slot的一整列取值, 每次取BLOCK_SIZE行, 每条指令对整块做一次块运算
+    // 栈上放的是块指针: 取变量直接指向列中的一段, 常量预先铺满一个块, 运算结果写入该栈深度独占的缓冲区
+    // simd为false时强制用标量块运算, 否则在支持AVX2的机器上用AVX2
+    template<typename T>
+    void evaluateColumns(const T* const* columns, size_t rows, T* results, bool simd = true) const
+    {
+        const bool avx2 = simd && cpuHasAVX2();
+        const int depth = std::max(_maxDepth, 1);
+        std::vector<T> buffers(depth * BLOCK_SIZE);
+        std::vector<T> constants;
+        for(const auto& ins : _code)
+        {
+            if(ins._op == OP_CONST)
+                constants.insert(constants.end(), BLOCK_SIZE, (T)ins._arg);
+        }
+        std::vector<const T*> stack(depth);
+        for(size_t begin = 0; begin < rows; begin += BLOCK_SIZE)
+        {
+            const size_t n = std::min(BLOCK_SIZE, rows - begin);
+            const T* nextConstant = constants.data();
+            int top = -1;
+            for(const auto& ins : _code)
+            {
+                if(ins._op == OP_CONST)
+                {
+                    stack[++top] = nextConstant;
+                    nextConstant += BLOCK_SIZE;
+                }
+                else if(ins._op == OP_LOAD)
+                    stack[++top] = columns[ins._arg] + begin;
+                else
+                {
+                    --top;
+                    T* out = buffers.data() + top * BLOCK_SIZE;
+                    if(avx2)
+                        blockBinaryAVX2(ins._op, out, stack[top], stack[top + 1], n);
+                    else
+                        blockBinaryScalar(ins._op, out, stack[top], stack[top + 1], n);
+                    stack[top] = out;
+                }
+            }
+            std::copy(stack[0], stack[0] + n, results + begin);
+        }
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Program& program)
+    {
+        static const char opChar[] = "  +-*/";
+        for(int i = 0; i < program._code.size(); ++i)
+        {
+            const Instruction& ins = program._code[i];
+            if(i)
+                os << ' ';
+            if(ins._op == OP_CONST)
+                os << ins._arg;
+            else if(ins._op == OP_LOAD)
+                os << program._variables[ins._arg];
+            else
+                os << opChar[ins._op];
+        }
+        return os;
+    }
+};
+
+template<typename T>
+inline T applyBinary(OpCode code, T l, T r)
+{
+    switch(code)
+    {
+    case OP_ADD: return add(l, r);
+    case OP_SUB: return subtract(l, r);
+    case OP_MUL: return multiply(l, r);
+    default:     return divide(l, r);
+    }
+}
+
+// 把字节码编译成x86-64机器码, 生成的函数是 T f(const T* slots), slots是一组变量取值(System V调用约定, 在rdi中)
+// 栈顶缓存在eax(int)或xmm0(double)中, 其余操作数放在机器栈上, 返回时结果正好在eax/xmm0中.
+// 代码先写进mmap得到的可读写页, 写完用mprotect改成只读可执行, 页不会同时可写又可执行.
+// 不是x86-64 Linux或者映射失败时ok()为false, evaluate退回字节码解释执行
+template<typename T>
+class JitExpression
+{
+public:
+    typedef T (*Function)(const T* slots);
+
+    explicit JitExpression(const Program& program) : _program(program), _page(nullptr), _size(0), _function(nullptr)
+    {
+#if defined(__x86_64__) && defined(__linux__)
+        std::vector<uint8_t> code;
+        emit(code);
+        long pageSize = sysconf(_SC_PAGESIZE);
+        _size = (code.size() + pageSize - 1) / pageSize * pageSize;
+        void* page = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(page == MAP_FAILED)
+            return;
+        memcpy(page, code.data(), code.size());
+        if(mprotect(page, _size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(page, _size);
+            return;
+        }
+        _page = page;
+        _function = (Function)page;
+#endif
+    }
+    JitExpression(const JitExpression&) = delete;
+    JitExpression& operator=(const JitExpression&) = delete;
+    ~JitExpression()
+    {
+#if defined(__x86_64__) && defined(__linux__)
+        if(_page)
+            munmap(_page, _size);
+#endif
+    }
+
+    bool ok() const
+    {
+        return _function != nullptr;
+    }
+
+    // 与Program::evaluate相同: bindings按行存放, 第r行的结果写入results[r]
+    void evaluate(const T* bindings, size_t rows, T* results) const
+    {
+        if(!_function)
+        {
+            _program.evaluate(bindings, rows, results);
+            return;
+        }
+        const size_t width = _program._variables.size();
+        for(size_t r = 0; r < rows; ++r)
+            results[r] = _function(bindings + r * width);
+    }
+
+private:
+    const Program& _program;
+    void* _page;
+    size_t _size;
+    Function _function;
+
+    static void bytes(std::vector<uint8_t>& code, std::initializer_list<uint8_t> list)
+    {
+        code.insert(code.end(), list);
+    }
+    template<typename V>
+    static void immediate(std::vector<uint8_t>& code, V v)
+    {
+        uint8_t buffer[sizeof(V)];
+        memcpy(buffer, &v, sizeof(V));
+        code.insert(code.end(), buffer, buffer + sizeof(V));
+    }
+
+    void emit(std::vector<uint8_t>& code) const;
+};
+
+template<>
+inline void JitExpression<int>::emit(std::vector<uint8_t>& code) const
+{
+    int depth = 0;
+    for(const auto& ins : _program._code)
+    {
+        if(ins._op == OP_CONST || ins._op == OP_LOAD)
+        {
+            if(depth++ > 0)
+                bytes(code, {0x50});                                // push rax
+            if(ins._op == OP_CONST)
+                bytes(code, {0xB8});                                // mov eax, imm32
+            else
+                bytes(code, {0x8B, 0x87});                          // mov eax, [rdi + disp32]
+            immediate<int32_t>(code, ins._op == OP_CONST ? ins._arg : ins._arg * 4);
+            continue;
+        }
+        --depth;
+        bytes(code, {0x89, 0xC1, 0x58});                            // mov ecx, eax; pop rax
+        switch(ins._op)
+        {
+        case OP_ADD: bytes(code, {0x01, 0xC8}); break;              // add eax, ecx
+        case OP_SUB: bytes(code, {0x29, 0xC8}); break;              // sub eax, ecx
+        case OP_MUL: bytes(code, {0x0F, 0xAF, 0xC1}); break;        // imul eax, ecx
+        default:
+            // 除数为0结果为0, 除数为-1取负, 其余cdq; idiv
+            bytes(code, {0x85, 0xC9, 0x74, 0x0A,                    // test ecx, ecx; jz zero
+                         0x83, 0xF9, 0xFF, 0x74, 0x09,              // cmp ecx, -1; je negate
+                         0x99, 0xF7, 0xF9, 0xEB, 0x06,              // cdq; idiv ecx; jmp done
+                         0x31, 0xC0, 0xEB, 0x02,                    // zero: xor eax, eax; jmp done
+                         0xF7, 0xD8});                              // negate: neg eax; done:
+            break;
+        }
+    }
+    bytes(code, {0xC3});                                            // ret
+}
+
+template<>
+inline void JitExpression<double>::emit(std::vector<uint8_t>& code) const
+{
+    int depth = 0;
+    for(const auto& ins : _program._code)
+    {
+        if(ins._op == OP_CONST || ins._op == OP_LOAD)
+        {
+            if(depth++ > 0)
+                bytes(code, {0x48, 0x83, 0xEC, 0x08, 0xF2, 0x0F, 0x11, 0x04, 0x24});    // sub rsp, 8; movsd [rsp], xmm0
+            if(ins._op == OP_CONST)
+            {
+                bytes(code, {0x48, 0xB8});                                              // mov rax, imm64
+                immediate<double>(code, ins._arg);
+                bytes(code, {0x66, 0x48, 0x0F, 0x6E, 0xC0});                            // movq xmm0, rax
+            }
+            else
+            {
+                bytes(code, {0xF2, 0x0F, 0x10, 0x87});                                  // movsd xmm0, [rdi + disp32]
+                immediate<int32_t>(code, ins._arg * 8);
+            }
+            continue;
+        }
+        --depth;
+        bytes(code, {0x66, 0x0F, 0x28, 0xC8,                                            // movapd xmm1, xmm0
+                     0xF2, 0x0F, 0x10, 0x04, 0x24,                                      // movsd xmm0, [rsp]
+                     0x48, 0x83, 0xC4, 0x08});                                          // add rsp, 8
+        static const uint8_t opcode[] = {0, 0, 0x58, 0x5C, 0x59, 0x5E};                 // addsd subsd mulsd divsd
+        bytes(code, {0xF2, 0x0F, opcode[ins._op], 0xC1});                               // op xmm0, xmm1
+    }
+    bytes(code, {0xC3});                                                                // ret
+}
+
+// 表达式DAG: 一批表达式的字节码合并成一张图, 结点按(运算, 参数, 左, 右)哈希合并,
+// 相同的子表达式不论出现在哪个表达式中都只有一个结点, 两个操作数都是常量的运算在建图时直接算出
+class ExprDAG
+{
+public:
+    struct Node
+    {
+        OpCode _op;
+        int32_t _arg;           // 常量值或变量槽位
+        int _left, _right;      // 运算的两个操作数, 叶子结点为-1
+        uint64_t _inputs;       // 依赖的变量槽位集合
+        int _cost;              // 子表达式中的运算个数
+    };
+
+    std::vector<Node> _nodes;   // 孩子总在父结点之前, 下标顺序就是拓扑序
+    std::string _variables;     // 整批表达式共用的变量槽位
+    std::vector<int> _roots;    // 每个表达式的根结点
+    int _instructions;          // 合并前各表达式的字节码指令总数
+
+    ExprDAG() : _instructions(0) {}
+
+    // 把一个表达式的字节码并入DAG, 返回它的根结点
+    int add(const Program& program)
+    {
+        std::vector<int> stack;
+        for(const auto& ins : program._code)
+        {
+            if(ins._op == OP_CONST)
+                stack.push_back(node(OP_CONST, ins._arg, -1, -1));
+            else if(ins._op == OP_LOAD)
+            {
+                char name = program._variables[ins._arg];
+                size_t slot = _variables.find(name);
+                if(slot == std::string::npos)
+                {
+                    slot = _variables.size();
+                    _variables += name;
+                }
+                stack.push_back(node(OP_LOAD, slot, -1, -1));
+            }
+            else
+            {
+                int r = stack.back();
+                stack.pop_back();
+                stack.back() = binary(ins._op, stack.back(), r);
+            }
+        }
+        _instructions += program._code.size();
+        _roots.push_back(stack.back());
+        return stack.back();
+    }
+
+private:
+    struct Key
+    {
+        OpCode _op;
+        int32_t _arg;
+        int _left, _right;
+        bool operator==(const Key& k) const
+        {
+            return _op == k._op && _arg == k._arg && _left == k._left && _right == k._right;
+        }
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key& k) const
+        {
+            uint64_t h = ((uint64_t)k._op << 32) ^ (uint32_t)k._arg;
+            h = h * 0x9E3779B97F4A7C15ULL ^ (uint32_t)k._left;
+            h = h * 0x9E3779B97F4A7C15ULL ^ (uint32_t)k._right;
+            return h ^ (h >> 29);
+        }
+    };
+    std::unordered_map<Key, int, KeyHash> _index;
+
+    int node(OpCode code, int32_t arg, int left, int right)
+    {
+        Key key = {code, arg, left, right};
+        auto it = _index.find(key);
+        if(it != _index.end())
+            return it->second;
+        Node n = {code, arg, left, right, 0, 0};
+        if(code == OP_LOAD)
+            n._inputs = 1ULL << arg;
+        else if(code != OP_CONST)
+        {
+            n._inputs = _nodes[left]._inputs | _nodes[right]._inputs;
+            n._cost = _nodes[left]._cost + _nodes[right]._cost + 1;
+        }
+        _nodes.push_back(n);
+        _index.emplace(key, _nodes.size() - 1);
+        return _nodes.size() - 1;
+    }
+
+    // 常量折叠只在int和double下结果相同时进行: 除法要能整除, 结果不能溢出int
+    int binary(OpCode code, int left, int right)
+    {
+        if(_nodes[left]._op == OP_CONST && _nodes[right]._op == OP_CONST)
+        {
+            int64_t l = _nodes[left]._arg, r = _nodes[right]._arg, v;
+            bool exact = true;
+            if(code == OP_DIV)
+            {
+                exact = r != 0 && l % r == 0;
+                v = exact ? l / r : 0;
+            }
+            else
+                v = applyBinary<int64_t>(code, l, r);
+            if(exact && v >= INT32_MIN && v <= INT32_MAX)
+                return node(OP_CONST, (int32_t)v, -1, -1);
+        }
+        return node(code, 0, left, right);
+    }
+};
+
+// 按DAG求值, 每个结点每行只算一次
+// 不用缓存时按拓扑序把所有结点顺序算一遍; 用缓存时只算各表达式的根需要的结点, 依赖的变量不多而运算较多的子表达式
+// 先查结果缓存, 命中时整棵子树都不用算. 缓存以(结点, 各输入变量的值)为键, 直接映射, 冲突时覆盖
+// 两种方式都按拓扑序循环, 不递归, 很深的表达式也不会栈溢出
+template<typename T>
+class DAGEvaluator
+{
+public:
+    static const int MAX_CACHE_INPUTS = 4;
+    static const int CACHE_MIN_COST = 4;
+    static const size_t CACHE_SIZE = 1 << 14;
+
+    explicit DAGEvaluator(const ExprDAG& dag, bool useCache = false)
+        : _dag(dag), _values(dag._nodes.size()), _stamp(dag._nodes.size(), 0), _hitStamp(dag._nodes.size(), 0), _row(0),
+          _cacheInputs(dag._nodes.size()), _cacheSlot(dag._nodes.size()), _hits(0), _lookups(0)
+    {
+        for(int n = 0; n < dag._nodes.size(); ++n)
+        {
+            const ExprDAG::Node& node = dag._nodes[n];
+            if(node._op == OP_CONST)
+                _values[n] = (T)node._arg;
+            else
+                _sweep.push_back(n);
+        }
+        for(int n = 0; useCache && n < dag._nodes.size(); ++n)
+        {
+            const ExprDAG::Node& node = dag._nodes[n];
+            if(node._cost < CACHE_MIN_COST || __builtin_popcountll(node._inputs) > MAX_CACHE_INPUTS)
+                continue;
+            for(int slot = 0; slot < 64; ++slot)
+            {
+                if(node._inputs >> slot & 1)
+                    _cacheInputs[n].push_back(slot);
+            }
+        }
+        if(useCache)
+            _cache.resize(CACHE_SIZE);
+    }
+
+    // slots是一组变量取值(按_dag._variables的顺序), 各表达式的值依次写入results
+    void evaluate(const T* slots, T* results)
+    {
+        const std::vector<ExprDAG::Node>& nodes = _dag._nodes;
+        if(_cache.empty())
+        {
+            T* values = _values.data();
+            for(int n : _sweep)
+            {
+                const ExprDAG::Node& node = nodes[n];
+                values[n] = node._op == OP_LOAD ? slots[node._arg] : applyBinary(node._op, values[node._left], values[node._right]);
+            }
+            for(int i = 0; i < _dag._roots.size(); ++i)
+                results[i] = values[_dag._roots[i]];
+            return;
+        }
+        // 逆拓扑序标记这一行需要的结点, 缓存命中的结点直接取值, 不再标记它的子结点
+        ++_row;
+        for(int i = 0; i < _dag._roots.size(); ++i)
+            _stamp[_dag._roots[i]] = _row;
+        for(auto it = _sweep.rbegin(); it != _sweep.rend(); ++it)
+        {
+            int n = *it;
+            const ExprDAG::Node& node = nodes[n];
+            if(_stamp[n] != _row || node._op == OP_LOAD)
+                continue;
+            if(!_cacheInputs[n].empty() && lookup(n, slots))
+                continue;
+            _stamp[node._left] = _row;
+            _stamp[node._right] = _row;
+        }
+        // 拓扑序计算需要而缓存没有命中的结点, 走缓存的结点算完写回缓存
+        for(int n : _sweep)
+        {
+            const ExprDAG::Node& node = nodes[n];
+            if(_stamp[n] != _row || _hitStamp[n] == _row)
+                continue;
+            if(node._op == OP_LOAD)
+            {
+                _values[n] = slots[node._arg];
+                continue;
+            }
+            T v = applyBinary(node._op, _values[node._left], _values[node._right]);
+            _values[n] = v;
+            if(!_cacheInputs[n].empty())
+            {
+                const std::vector<int>& inputs = _cacheInputs[n];
+                CacheEntry& entry = _cache[_cacheSlot[n]];
+                entry._node = n;
+                for(int i = 0; i < inputs.size(); ++i)
+                    entry._inputs[i] = slots[inputs[i]];
+                entry._value = v;
+            }
+        }
+        for(int i = 0; i < _dag._roots.size(); ++i)
+            results[i] = _values[_dag._roots[i]];
+    }
+
+    size_t hits() const { return _hits; }
+    size_t lookups() const { return _lookups; }
+
+private:
+    struct CacheEntry
+    {
+        int _node;
+        T _inputs[MAX_CACHE_INPUTS];
+        T _value;
+        CacheEntry() : _node(-1) {}
+    };
+
+    const ExprDAG& _dag;
+    std::vector<int> _sweep;        // 拓扑序中除常量以外的结点
+    std::vector<T> _values;
+    std::vector<size_t> _stamp;     // _stamp[n] == _row说明这一行需要结点n的值
+    std::vector<size_t> _hitStamp;  // _hitStamp[n] == _row说明结点n这一行的值取自缓存
+    size_t _row;
+    std::vector<std::vector<int>> _cacheInputs;     // 走缓存的结点所依赖的变量槽位, 其余结点为空
+    std::vector<size_t> _cacheSlot;                 // 结点这一行在缓存中对应的位置, 未命中时算完写回这里
+    std::vector<CacheEntry> _cache;
+    size_t _hits, _lookups;
+
+    // 按结点n及其输入变量的取值查缓存, 命中时把值存入_values[n]并返回true
+    bool lookup(int n, const T* slots)
+    {
+        // 输入按位比较, 0.0和-0.0、NaN都不会错误命中
+        const std::vector<int>& inputs = _cacheInputs[n];
+        T key[MAX_CACHE_INPUTS];
+        uint64_t h = n * 0x9E3779B97F4A7C15ULL;
+        for(int i = 0; i < inputs.size(); ++i)
+        {
+            key[i] = slots[inputs[i]];
+            uint64_t bits = 0;
+            memcpy(&bits, &key[i], sizeof(T));
+            // double的信息在高位, 先折到低位再乘
+            h = (h ^ bits ^ (bits >> 32)) * 0xFF51AFD7ED558CCDULL;
+            h ^= h >> 32;
+        }
+        _cacheSlot[n] = h & (CACHE_SIZE - 1);
+        const CacheEntry& entry = _cache[_cacheSlot[n]];
+        ++_lookups;
+        if(entry._node != n || memcmp(entry._inputs, key, inputs.size() * sizeof(T)) != 0)
+            return false;
+        _values[n] = entry._value;
+        _hitStamp[n] = _row;
+        ++_hits;
+        return true;
+    }
+};
+
 
 std::vector<std::string> FileRead(const std::string &filepath)
 {
@@ -177,180 +903,264 @@ std::vector<std::string> FileRead(const std::string &filepath)
     return ret;
 }
 
+// 句子去掉末尾一个结束符#之后的长度, #只作为结束符, 出现在这之前的#都是错误
+inline size_t endOfSentence(const std::string& sentence)
+{
+    return !sentence.empty() && sentence.back() == '#' ? sentence.size() - 1 : sentence.size();
+}
+
 class OperatorGrammarParser
 {
 public:
-    std::map<char, std::set<char>> getAllFirstVT(const Grammar& g)
+    // 求所有非终结符的FirstVT(last为true时求LastVT), 第i行是第i个非终结符的集合, 第k位表示第k个终结符
+    // A->a...或A->Ba...时a属于FirstVT(A); A->B...时FirstVT(B)包含于FirstVT(A).
+    // 后一条关系记成非终结符之间的可达矩阵, 用Warshall算法按字并行求传递闭包, 再把可达的非终结符的集合并起来
+    std::vector<BitRow> getVTBits(const Grammar& g, bool last)
     {
-        std::map<char, std::set<char>> firstVT;
-        for(auto& c : g._nonTerminalSymbols)
-            firstVT[c] = {};
-        bool change = true;
-        while(change)
+        const int N = g._nonTerminalSymbols.size(), T = g._terminalSymbols.size();
+        std::vector<BitRow> reach(N, BitRow((N + 63) / 64, 0));
+        std::vector<BitRow> direct(N, BitRow((T + 63) / 64, 0));
+        for(auto& p : g._productionRules)
         {
-            change = false;
-            for(auto& p : g._productionRules)
+            int A = g.getIndexOfNonTerminal(p._lhs);
+            const std::string& rhs = p._rhs;
+            if(A < 0 || rhs.empty())
+                continue;
+            char x0 = last ? rhs[rhs.size() - 1] : rhs[0];
+            if(g.isTerminal(x0))
+                setBit(direct[A], g.getIndexOfTerminal(x0));
+            else if(g.isNonTerminal(x0))
             {
-                char lhs = p._lhs;
-                std::string rhs = p._rhs;
-                if(g.isTerminal(rhs[0]))
-                {
-                    if(firstVT[lhs].find(rhs[0]) == firstVT[lhs].end())
-                    {
-                        firstVT[lhs].insert(rhs[0]);
-                        change = true;
-                    }
-                }
-                else
+                setBit(reach[A], g.getIndexOfNonTerminal(x0));
+                if(rhs.size() > 1)
                 {
-                    if(rhs.size() > 1 && g.isTerminal(rhs[1]))
-                    {
-                        if(firstVT[lhs].find(rhs[1]) == firstVT[lhs].end())
-                        {
-                            firstVT[lhs].insert(rhs[1]);
-                            change = true;
-                        }
-                    }
-                    else
-                    {
-                        for(auto& c : firstVT[rhs[0]])
-                        {
-                            if(firstVT[lhs].find(c) == firstVT[lhs].end())
-                            {
-                                firstVT[lhs].insert(c);
-                                change = true;
-                            }
-                        }
-                    }
+                    char x1 = last ? rhs[rhs.size() - 2] : rhs[1];
+                    if(g.isTerminal(x1))
+                        setBit(direct[A], g.getIndexOfTerminal(x1));
                 }
             }
         }
-        return firstVT;
+        for(int k = 0; k < N; ++k)
+        {
+            for(int i = 0; i < N; ++i)
+            {
+                if(testBit(reach[i], k))
+                    orInto(reach[i], reach[k]);
+            }
+        }
+        std::vector<BitRow> vt = direct;
+        for(int i = 0; i < N; ++i)
+        {
+            for(int k = 0; k < N; ++k)
+            {
+                if(testBit(reach[i], k))
+                    orInto(vt[i], direct[k]);
+            }
+        }
+        return vt;
     }
 
-    std::map<char, std::set<char>> getAllLastVT(const Grammar& g)
+    // 把getVTBits的结果转换成非终结符 -> 终结符集合, 用于输出
+    std::map<char, std::set<char>> toSets(const Grammar& g, const std::vector<BitRow>& vt)
     {
-        std::map<char, std::set<char>> lastVT;
-        for(auto& c : g._nonTerminalSymbols)
-            lastVT[c] = {};
-        bool change = true;
-        while(change)
+        std::map<char, std::set<char>> sets;
+        for(int i = 0; i < vt.size(); ++i)
         {
-            change = false;
-            for(auto& p : g._productionRules)
+            std::set<char>& set = sets[g._nonTerminalSymbols[i]];
+            for(int k = 0; k < g._terminalSymbols.size(); ++k)
             {
-                char lhs = p._lhs;
-                std::string rhs = p._rhs;
-                if(g.isTerminal(rhs[rhs.size() - 1]))
-                {
-                    if(lastVT[lhs].find(rhs[rhs.size() - 1]) == lastVT[lhs].end())
-                    {
-                        lastVT[lhs].insert(rhs[rhs.size() - 1]);
-                        change = true;
-                    }
-                }
-                else
-                {
-                    if(rhs.size() > 1 && g.isTerminal(rhs[rhs.size() - 2]))
-                    {
-                        if(lastVT[lhs].find(rhs[rhs.size() - 2]) == lastVT[lhs].end())
-                        {
-                            lastVT[lhs].insert(rhs[rhs.size() - 2]);
-                            change = true;
-                        }
-                    }
-                    else
-                    {
-                        for(auto& c : lastVT[rhs[rhs.size() - 1]])
-                        {
-                            if(lastVT[lhs].find(c) == lastVT[lhs].end())
-                            {
-                                lastVT[lhs].insert(c);
-                                change = true;
-                            }
-                        }
-                    }
-                }
+                if(testBit(vt[i], k))
+                    set.insert(g._terminalSymbols[k]);
             }
         }
-        return lastVT;
+        return sets;
     }
 
     PriorityTable constructPriorityTable(const Grammar& g)
     {
-        auto firstVT = getAllFirstVT(g);
-        auto lastVT = getAllLastVT(g);
+        return constructPriorityTable(g, getVTBits(g, false), getVTBits(g, true));
+    }
 
-        PriorityTable table(grammar._terminalSymbols.size(), std::vector<char>(grammar._terminalSymbols.size(), ' '));
+    // 扫描一遍产生式填表, FirstVT/LastVT由调用者给出, 输出集合与构造表时不必再求一遍
+    PriorityTable constructPriorityTable(const Grammar& g, const std::vector<BitRow>& firstVT, const std::vector<BitRow>& lastVT)
+    {
+        const int T = g._terminalSymbols.size();
+        PriorityTable table(T, std::vector<char>(T, ' '));
         for(auto& p : g._productionRules)
         {
-            char lhs = p._lhs;
-            std::string rhs = p._rhs;
-            for(int i = 0; i < rhs.size() - 1; ++i)
+            const std::string& rhs = p._rhs;
+            for(int i = 0; i + 1 < rhs.size(); ++i)
             {
-                if(i + 1 < rhs.size() && g.isTerminal(rhs[i]) && g.isTerminal(rhs[i + 1]))
-                {
-                    int row = g.getIndexOfTerminal(rhs[i]);
-                    int col = g.getIndexOfTerminal(rhs[i + 1]);
-                    table[row][col] = '=';
-                }
-                if(i + 1 < rhs.size() && i + 2 < rhs.size() && g.isTerminal(rhs[i]) && g.isNonTerminal(rhs[i + 1]) && g.isTerminal(rhs[i + 2]))
+                bool terminal0 = g.isTerminal(rhs[i]), terminal1 = g.isTerminal(rhs[i + 1]);
+                bool nonTerminal0 = g.isNonTerminal(rhs[i]), nonTerminal1 = g.isNonTerminal(rhs[i + 1]);
+                if(terminal0 && terminal1)
+                    table[g.getIndexOfTerminal(rhs[i])][g.getIndexOfTerminal(rhs[i + 1])] = '=';
+                if(i + 2 < rhs.size() && terminal0 && nonTerminal1 && g.isTerminal(rhs[i + 2]))
+                    table[g.getIndexOfTerminal(rhs[i])][g.getIndexOfTerminal(rhs[i + 2])] = '=';
+                if(terminal0 && nonTerminal1)
                 {
-                    int row = g.getIndexOfTerminal(rhs[i]);
-                    int col = g.getIndexOfTerminal(rhs[i + 2]);
-                    table[row][col] = '=';
-                }
-                if(i + 1 < rhs.size() && g.isTerminal(rhs[i]) && g.isNonTerminal(rhs[i + 1]))
-                {
-                    for(auto& c : firstVT[rhs[i + 1]])
+                    std::vector<char>& row = table[g.getIndexOfTerminal(rhs[i])];
+                    const BitRow& first = firstVT[g.getIndexOfNonTerminal(rhs[i + 1])];
+                    for(int col = 0; col < T; ++col)
                     {
-                        int row = g.getIndexOfTerminal(rhs[i]);
-                        int col = g.getIndexOfTerminal(c);
-                        table[row][col] = '<';
+                        if(testBit(first, col))
+                            row[col] = '<';
                     }
                 }
-                if(i + 1 < rhs.size() && g.isNonTerminal(rhs[i]) && g.isTerminal(rhs[i + 1]))
+                if(nonTerminal0 && terminal1)
                 {
-                    for(auto& c : lastVT[rhs[i]])
+                    int col = g.getIndexOfTerminal(rhs[i + 1]);
+                    const BitRow& lastSet = lastVT[g.getIndexOfNonTerminal(rhs[i])];
+                    for(int row = 0; row < T; ++row)
                     {
-                        int row = g.getIndexOfTerminal(c);
-                        int col = g.getIndexOfTerminal(rhs[i + 1]);
-                        table[row][col] = '>';
+                        if(testBit(lastSet, row))
+                            table[row][col] = '>';
                     }
                 }
             }
-            // 处理终结符 #
-            for(int i = 0; i < g._terminalSymbols.size() - 1; ++i)
+        }
+        // 处理终结符 #
+        int end = g.getIndexOfTerminal('#');
+        for(int i = 0; i < T - 1; ++i)
+        {
+            table[i][end] = '>';
+            table[end][i] = '<';
+        }
+        return table;
+    }
+
+    // 由优先级表构造优先函数
+    // 每个终结符a对应结点f_a和g_a, a=b时用并查集把f_a和g_b合并为一个结点; a>b连边f_a->g_b, a<b连边g_b->f_a,
+    // 函数值取从结点出发的最长路径长度(拓扑序逆序求); 图中有环时优先函数不存在, 返回false
+    bool constructPrecedenceFunctions(const PriorityTable& table, PrecedenceFunctions& functions)
+    {
+        const int T = table.size();
+        std::vector<int> parent(2 * T);
+        for(int i = 0; i < 2 * T; ++i)
+            parent[i] = i;
+        std::function<int(int)> find = [&](int x) {
+            while(parent[x] != x)
+                x = parent[x] = parent[parent[x]];
+            return x;
+        };
+        for(int a = 0; a < T; ++a)
+        {
+            for(int b = 0; b < T; ++b)
+            {
+                if(table[a][b] == '=')
+                    parent[find(a)] = find(T + b);
+            }
+        }
+        std::vector<std::vector<int>> edges(2 * T);
+        std::vector<int> indegree(2 * T, 0);
+        for(int a = 0; a < T; ++a)
+        {
+            for(int b = 0; b < T; ++b)
             {
-                table[i][g.getIndexOfTerminal('#')] = '>';
-                table[g.getIndexOfTerminal('#')][i] = '<';
+                int from = -1, to = -1;
+                if(table[a][b] == '>')
+                    from = find(a), to = find(T + b);
+                else if(table[a][b] == '<')
+                    from = find(T + b), to = find(a);
+                else
+                    continue;
+                if(from == to)
+                    return false;
+                edges[from].push_back(to);
+                ++indegree[to];
             }
-
         }
-        return table;
+        // Kahn算法求拓扑序, 排不完说明有环
+        std::vector<int> order;
+        int nodes = 0;
+        for(int x = 0; x < 2 * T; ++x)
+        {
+            if(find(x) != x)
+                continue;
+            ++nodes;
+            if(indegree[x] == 0)
+                order.push_back(x);
+        }
+        for(int i = 0; i < order.size(); ++i)
+        {
+            for(auto y : edges[order[i]])
+            {
+                if(--indegree[y] == 0)
+                    order.push_back(y);
+            }
+        }
+        if(order.size() != nodes)
+            return false;
+        std::vector<int> length(2 * T, 0);
+        for(int i = (int)order.size() - 1; i >= 0; --i)
+        {
+            for(auto y : edges[order[i]])
+                length[order[i]] = std::max(length[order[i]], length[y] + 1);
+        }
+        functions._f.resize(T);
+        functions._g.resize(T);
+        for(int a = 0; a < T; ++a)
+        {
+            functions._f[a] = length[find(a)];
+            functions._g[a] = length[find(T + a)];
+        }
+        return true;
     }
 
-    void operatorGrammarParser(const Grammar& g, std::string sentence)
+    // 分析句子并求值, 结果存入value, 句子不合法时返回false
+    // functions不为空时用优先函数比较优先关系, 否则查优先级表; 文法、优先级表、优先函数都只读, 可以被多个线程共享,
+    // 分析中改变的状态都在ctx中; trace为true时输出分析过程和错误信息
+    bool operatorGrammarParser(const Grammar& g, const PriorityTable& priorityTable, const std::string& sentence, EvalContext& ctx,
+        int& value, const PrecedenceFunctions* functions = nullptr, bool trace = true)
     {
-        auto priorityTable = constructPriorityTable(g);
-        std::deque<char> analyseStack;
+        auto relation = [&](char a, char b) {
+            int i = g.getIndexOfTerminal(a), j = g.getIndexOfTerminal(b);
+            return functions ? functions->relation(i, j) : priorityTable[i][j];
+        };
+        ctx.reset(sentence.size());
+        std::vector<char>& analyseStack = ctx._analyseStack;
         analyseStack.push_back('#');
         int idx = 0;
         int count = 1;
         int pos = 0;
-        std::cout << "算符优先文法分析过程:" << std::endl;
-        std::cout << "步骤\t\t分析栈\t\t输入串\t\t动作" << std::endl;
+        if(trace)
+        {
+            std::cout << "算符优先文法分析过程:" << std::endl;
+            std::cout << "步骤\t\t分析栈\t\t输入串\t\t动作" << std::endl;
+        }
+        // 句子末尾可以带一个结束符#
+        const size_t length = endOfSentence(sentence);
         while(1)
         {
-            char a = sentence[idx];
-            if(analyseStack.size() == 2 && analyseStack.back() == g._startSymbol && sentence[idx] == '#')
+            char a = idx < length ? sentence[idx] : '#';
+            if(g.getIndexOfTerminal(a) < 0)
+            {
+                if(trace)
+                    std::cout << "Error: 无法识别的字符" << a << "!" << std::endl;
+                return false;
+            }
+            // #只作为句子的结束符, 不能出现在句子中间
+            if(a == '#' && idx < length)
+            {
+                if(trace)
+                    std::cout << "Error: 句子中不能出现#!" << std::endl;
+                return false;
+            }
+            if(analyseStack.size() == 2 && g.isNonTerminal(analyseStack.back()) && a == '#')
             {
-                std::cout << count++ << "\t\t";
-                for(auto& c : analyseStack)
-                    std::cout << c;
-                std::cout << "\t\t" << sentence.substr(idx) << "\t\t接受" << std::endl;
-                std::cout << "接受: "<< sentence << ", 表达式的值为: " << numStack.top() << std::endl;
-                return;
+                value = ctx._numStack.empty() || ctx._noValue ? 0 : ctx._numStack.back();
+                if(trace)
+                {
+                    std::cout << count++ << "\t\t";
+                    for(auto& c : analyseStack)
+                        std::cout << c;
+                    std::cout << "\t\t" << sentence.substr(idx) << "\t\t接受" << std::endl;
+                    if(ctx._noValue)
+                        std::cout << "接受: "<< sentence << ", 句子中有变量, 用-c编译后用-b给出变量的取值才能求值" << std::endl;
+                    else
+                        std::cout << "接受: "<< sentence << ", 表达式的值为: " << value << std::endl;
+                }
+                return true;
             }
             else
             {
@@ -358,29 +1168,42 @@ public:
                     pos = analyseStack.size() - 1;
                 else
                     pos = analyseStack.size() - 2;
-                if(priorityTable[g.getIndexOfTerminal(analyseStack[pos])][g.getIndexOfTerminal(a)] == '<'
-                    || priorityTable[g.getIndexOfTerminal(analyseStack[pos])][g.getIndexOfTerminal(a)] == '=')
+                char rel = relation(analyseStack[pos], a);
+                if(rel == '<' || rel == '=')
                 {
-
-                    std::cout << count++ << "\t\t";
-                    for(auto& c : analyseStack)
-                        std::cout << c;
-                    std::cout << "\t\t" << sentence.substr(idx) << "\t\t移进" << std::endl;
+                    // 优先函数可能给出#=#, 输入已经读完时不能再移进
+                    if(a == '#' || idx >= length)
+                    {
+                        if(trace)
+                            std::cout << "Error: 句子不完整!" << std::endl;
+                        return false;
+                    }
+                    if(trace)
+                    {
+                        std::cout << count++ << "\t\t";
+                        for(auto& c : analyseStack)
+                            std::cout << c;
+                        std::cout << "\t\t" << sentence.substr(idx) << "\t\t移进" << std::endl;
+                    }
                     analyseStack.push_back(a);
 
                     if(a >= '0' && a <= '9')
-                        numStack.push(a - '0');
+                        ctx._numStack.push_back(a - '0');
+                    else if(g.isVariable(a))
+                        ctx._noValue = true;
                     if(op.find(a) != std::string::npos)
-                        opStack.push(a);
+                        ctx._opStack.push_back(a);
                     ++idx;
                 }
-                else if(priorityTable[g.getIndexOfTerminal(analyseStack[pos])][g.getIndexOfTerminal(a)] == '>')
+                else if(rel == '>')
                 {
-
-                    std::cout << count++ << "\t\t";
-                    for(auto& c : analyseStack)
-                        std::cout << c;
-                    std::cout << "\t\t" << sentence.substr(idx) << "\t\t规约" << std::endl;
+                    if(trace)
+                    {
+                        std::cout << count++ << "\t\t";
+                        for(auto& c : analyseStack)
+                            std::cout << c;
+                        std::cout << "\t\t" << sentence.substr(idx) << "\t\t规约" << std::endl;
+                    }
                     bool reductable = false;
                     std::string rhs = "";
                     // for(int i = analyseStack.size() - 1; i >= 0; --i)
@@ -402,9 +1225,15 @@ public:
                     //     analyseStack.push_back(g.reduction(rhs));
                     //     continue;
                     // }
+                    // 从栈顶终结符往下找, 每个终结符与它右边最近的终结符比较, 第一个<的右边就是句柄的开头
+                    int right = pos;
                     for(int i = pos - 1; i >= 0; --i)
                     {
-                        if(g.isTerminal(analyseStack[i]) && priorityTable[g.getIndexOfTerminal(analyseStack[i])][g.getIndexOfTerminal(analyseStack[pos])] == '<')
+                        if(!g.isTerminal(analyseStack[i]))
+                            continue;
+                        if(relation(analyseStack[i], analyseStack[right]) != '<')
+                            right = i;
+                        else
                         {
                             int begin = i + 1;
                             int deleteCount = analyseStack.size() - begin;
@@ -414,7 +1243,7 @@ public:
                             // std::cout << rhs << std::endl;
                             while(deleteCount--)
                                 analyseStack.pop_back();
-                            char lhs = g.reduction(rhs);
+                            char lhs = g.reduction(rhs, ctx);
                             if(lhs != '\0')
                             {
                                 analyseStack.push_back(lhs);
@@ -422,8 +1251,9 @@ public:
                             }
                             else
                             {
-                                std::cout << "Error: 不存在规约的产生式!" << std::endl;
-                                exit(-1);
+                                if(trace)
+                                    std::cout << "Error: 不存在规约的产生式!" << std::endl;
+                                return false;
                             }
                         }
                     }
@@ -431,14 +1261,103 @@ public:
                 }
                 else
                 {
-                    std::cout << "Error: 不存在优先关系无法识别的算符优先文法!" << std::endl;
-                    exit(-1);
+                    if(trace)
+                        std::cout << "Error: 不存在优先关系无法识别的算符优先文法!" << std::endl;
+                    return false;
                 }
 
             }
         }
     }
 
+    // 把句子编译成字节码: 移进/规约的过程与operatorGrammarParser相同, 但不输出分析过程也不求值,
+    // 移进操作数时生成取常量/取变量指令, 按二元运算的产生式规约时生成运算指令; 句子不合法时返回false
+    bool compile(const Grammar& g, const std::string& sentence, const PriorityTable& priorityTable, Program& program)
+    {
+        program = Program();
+        std::vector<char> analyseStack(1, '#');
+        int idx = 0, depth = 0;
+        const size_t length = endOfSentence(sentence);
+        while(1)
+        {
+            char a = idx < length ? sentence[idx] : '#';
+            if(g.getIndexOfTerminal(a) < 0)
+            {
+                std::cout << "Error: 无法识别的字符" << a << "!" << std::endl;
+                return false;
+            }
+            if(a == '#' && idx < length)
+            {
+                std::cout << "Error: 句子中不能出现#!" << std::endl;
+                return false;
+            }
+            if(analyseStack.size() == 2 && g.isNonTerminal(analyseStack.back()) && a == '#')
+            {
+                if(depth == 1)
+                    return true;
+                std::cout << "Error: 句子不是只含+-*/的算术表达式, 无法编译!" << std::endl;
+                return false;
+            }
+            int pos = g.isTerminal(analyseStack.back()) ? analyseStack.size() - 1 : analyseStack.size() - 2;
+            char rel = priorityTable[g.getIndexOfTerminal(analyseStack[pos])][g.getIndexOfTerminal(a)];
+            if(rel == '<' || rel == '=')
+            {
+                if(a == '#')
+                {
+                    std::cout << "Error: 句子不完整!" << std::endl;
+                    return false;
+                }
+                analyseStack.push_back(a);
+                if(a >= '0' && a <= '9')
+                    program._code.push_back({OP_CONST, a - '0'});
+                else if(g.isVariable(a))
+                {
+                    size_t slot = program._variables.find(a);
+                    if(slot == std::string::npos)
+                    {
+                        slot = program._variables.size();
+                        program._variables += a;
+                    }
+                    program._code.push_back({OP_LOAD, (int32_t)slot});
+                }
+                if(g.isOperand(a))
+                    program._maxDepth = std::max(program._maxDepth, ++depth);
+                ++idx;
+            }
+            else if(rel == '>')
+            {
+                int i = pos - 1, right = pos;
+                for(; i >= 0; --i)
+                {
+                    if(!g.isTerminal(analyseStack[i]))
+                        continue;
+                    if(priorityTable[g.getIndexOfTerminal(analyseStack[i])][g.getIndexOfTerminal(analyseStack[right])] == '<')
+                        break;
+                    right = i;
+                }
+                std::string rhs(analyseStack.begin() + i + 1, analyseStack.end());
+                char lhs = g.match(rhs);
+                if(i < 0 || lhs == '\0')
+                {
+                    std::cout << "Error: 不存在规约的产生式!" << std::endl;
+                    return false;
+                }
+                analyseStack.resize(i + 1);
+                analyseStack.push_back(lhs);
+                if(rhs.size() == 3 && op.find(rhs[1]) != std::string::npos)
+                {
+                    program._code.push_back({(OpCode)(OP_ADD + op.find(rhs[1])), 0});
+                    --depth;
+                }
+            }
+            else
+            {
+                std::cout << "Error: 不存在优先关系无法识别的算符优先文法!" << std::endl;
+                return false;
+            }
+        }
+    }
+
     void printSet(const std::map<char, std::set<char>>& Set, const std::string& tag)
     {
         for(const auto& p : Set)
@@ -450,6 +1369,20 @@ public:
         }
     }
 
+    void printPrecedenceFunctions(const PrecedenceFunctions& functions, const Grammar& g)
+    {
+        std::cout << "优先函数:" << std::endl;
+        for(auto& c : g._terminalSymbols)
+            std::cout << "\t" << c;
+        std::cout << std::endl << "f";
+        for(auto v : functions._f)
+            std::cout << "\t" << v;
+        std::cout << std::endl << "g";
+        for(auto v : functions._g)
+            std::cout << "\t" << v;
+        std::cout << std::endl;
+    }
+
     void printPriorityTable(const PriorityTable& priorityTable, const Grammar& g)
     {
         std::cout << "算符优先级表:" << std::endl;
@@ -470,6 +1403,399 @@ public:
 };
 
 
+// Pratt(自顶向下算符优先)分析: 由优先函数得到结合力, 终结符b的左结合力lbp(b)=g(b), 终结符a的右结合力rbp(a)=f(a).
+// 栈顶运算符a与下一个运算符b, lbp(b)>rbp(a)即a<b时b先结合, 否则先算a; f(a)=g(b)的一对终结符是括号.
+// 运算符栈和数字栈用EvalContext中预留的空间, 不递归, 每步不分配内存也不输出; 只检查句子的中缀形式和括号配对,
+// 不逐个核对产生式, 长句子(例如生成的有10^5个运算符的公式)用它分析
+class PrattParser
+{
+public:
+    enum Kind : uint8_t { INVALID, OPERAND, BINARY, OPEN, CLOSE, END };
+
+    PrattParser(const Grammar& g, const PriorityTable& table, const PrecedenceFunctions& functions)
+    {
+        std::fill(_kind, _kind + 256, INVALID);
+        std::fill(_lbp, _lbp + 256, 0);
+        std::fill(_rbp, _rbp + 256, 0);
+        for(int c = 0; c < 256; ++c)
+        {
+            int t = g.getIndexOfTerminal(c);
+            if(t < 0)
+                continue;
+            _lbp[c] = functions._g[t];
+            _rbp[c] = functions._f[t];
+            if(c == '#')
+                _kind[c] = END;
+            else if(g.isOperand(c))
+                _kind[c] = OPERAND;
+            else
+                _kind[c] = BINARY;
+        }
+        // 优先级表中a=b的一对是括号, a是左括号, b是右括号; #=#不是括号, #始终是结束符
+        for(int a = 0; a < table.size(); ++a)
+        {
+            for(int b = 0; b < table.size(); ++b)
+            {
+                if(table[a][b] == '=' && g._terminalSymbols[a] != '#' && g._terminalSymbols[b] != '#')
+                {
+                    _kind[(unsigned char)g._terminalSymbols[a]] = OPEN;
+                    _kind[(unsigned char)g._terminalSymbols[b]] = CLOSE;
+                }
+            }
+        }
+    }
+
+    // 分析句子并求值, 结果存入value; 句子不合法返回false
+    bool parse(const std::string& sentence, EvalContext& ctx, int& value) const
+    {
+        ctx.reset(sentence.size());
+        std::vector<char>& ops = ctx._opStack;
+        std::vector<int>& values = ctx._numStack;
+        bool expectOperand = true;
+        const size_t length = endOfSentence(sentence);
+        for(size_t idx = 0; ; ++idx)
+        {
+            unsigned char c = idx < length ? sentence[idx] : '#';
+            Kind kind = _kind[c];
+            // 末尾以外的#不是结束符
+            if(kind == END && idx < length)
+                return false;
+            if(expectOperand)
+            {
+                if(kind == OPERAND)
+                {
+                    if(c >= '0' && c <= '9')
+                        values.push_back(c - '0');
+                    else
+                    {
+                        values.push_back(0);
+                        ctx._noValue = true;
+                    }
+                    expectOperand = false;
+                }
+                else if(kind == OPEN)
+                    ops.push_back(c);
+                else
+                    return false;
+                continue;
+            }
+            if(kind != BINARY && kind != CLOSE && kind != END)
+                return false;
+            // 栈顶运算符的右结合力不小于c的左结合力时先把它算掉
+            while(!ops.empty() && _kind[(unsigned char)ops.back()] == BINARY && (kind == END || _rbp[(unsigned char)ops.back()] >= _lbp[c]))
+                reduce(ctx);
+            if(kind == BINARY)
+            {
+                ops.push_back(c);
+                expectOperand = true;
+            }
+            else if(kind == CLOSE)
+            {
+                if(ops.empty() || _kind[(unsigned char)ops.back()] != OPEN || _rbp[(unsigned char)ops.back()] != _lbp[c])
+                    return false;
+                ops.pop_back();
+            }
+            else
+            {
+                if(!ops.empty())
+                    return false;
+                value = ctx._noValue ? 0 : values.back();
+                return true;
+            }
+        }
+    }
+
+private:
+    Kind _kind[256];
+    int _lbp[256];
+    int _rbp[256];
+
+    void reduce(EvalContext& ctx) const
+    {
+        char c = ctx._opStack.back();
+        ctx._opStack.pop_back();
+        int r = ctx._numStack.back();
+        ctx._numStack.pop_back();
+        int& l = ctx._numStack.back();
+        size_t k = op.find(c);
+        if(k != std::string::npos)
+            l = applyBinary((OpCode)(OP_ADD + k), l, r);
+        else
+            ctx._noValue = true;
+    }
+};
+
+// 生成一个有n个运算符的随机算术表达式(操作数是数字1-9或variables中的变量, 运算符+-*/, 随机加括号)
+std::string generateExpression(size_t n, unsigned seed, const std::string& variables = "")
+{
+    std::mt19937 rng(seed);
+    std::string s;
+    s.reserve(n * 4 + 2);
+    int depth = 0;
+    for(size_t k = 0; k <= n; ++k)
+    {
+        while(rng() % 8 == 0)
+        {
+            s += '(';
+            ++depth;
+        }
+        size_t operand = rng() % (9 + variables.size());
+        s += operand < 9 ? (char)('1' + operand) : variables[operand - 9];
+        while(depth > 0 && rng() % 6 == 0)
+        {
+            s += ')';
+            --depth;
+        }
+        if(k < n)
+            s += op[rng() % 4];
+    }
+    s.append(depth, ')');
+    return s + '#';
+}
+
+// 按位比较两组结果, NaN与NaN也算相同
+template<typename T>
+bool sameResults(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+// 读入变量取值文件, 每行依次给出各变量的取值, 按列存放后做列式求值, 每行输出一个结果
+template<typename T>
+void evaluateBindings(const Program& program, const std::string& bindingsFile, bool useJit)
+{
+    std::fstream fin(bindingsFile, std::ios::in);
+    if(!fin.is_open())
+    {
+        std::cerr << "Error: open file failed!" << std::endl;
+        exit(-1);
+    }
+    const size_t width = program._variables.size();
+    std::vector<std::vector<T>> columns(width);
+    size_t count = 0;
+    T v;
+    while(width && fin >> v)
+        columns[count++ % width].push_back(v);
+    size_t rows = width ? count / width : 1;
+    std::vector<T> results(rows);
+    if(useJit)
+    {
+        // JIT按行求值, 把列转回按行存放
+        std::vector<T> rowMajor(rows * width);
+        for(size_t r = 0; r < rows; ++r)
+        {
+            for(size_t c = 0; c < width; ++c)
+                rowMajor[r * width + c] = columns[c][r];
+        }
+        JitExpression<T> jit(program);
+        if(!jit.ok())
+            std::cerr << "JIT不可用, 改用解释执行" << std::endl;
+        jit.evaluate(rowMajor.data(), rows, results.data());
+    }
+    else
+    {
+        std::vector<const T*> columnPointers;
+        for(auto& column : columns)
+            columnPointers.push_back(column.data());
+        program.evaluateColumns(columnPointers.data(), rows, results.data());
+    }
+    std::string out;
+    for(auto r : results)
+        out += std::to_string(r) + '\n';
+    std::cout << out;
+}
+
+// 随机生成rows行变量取值, 比较逐行解释执行、标量块运算、AVX2块运算的耗时, 并核对结果是否一致
+template<typename T>
+void benchmark(const Program& program, size_t rows, const std::string& typeName)
+{
+    const size_t width = program._variables.size();
+    std::mt19937 rng(2024);
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    std::vector<T> rowMajor(rows * width);
+    std::vector<std::vector<T>> columns(width, std::vector<T>(rows));
+    std::vector<const T*> columnPointers;
+    for(size_t r = 0; r < rows; ++r)
+    {
+        for(size_t c = 0; c < width; ++c)
+            rowMajor[r * width + c] = columns[c][r] = (T)dist(rng);
+    }
+    for(auto& column : columns)
+        columnPointers.push_back(column.data());
+    std::vector<T> expected(rows), scalar(rows), simd(rows);
+    auto timeIt = [](std::function<void()> f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::vector<T> jitted(rows);
+    JitExpression<T> jit(program);
+    double tRow = timeIt([&] { program.evaluate(rowMajor.data(), rows, expected.data()); });
+    double tJit = timeIt([&] { jit.evaluate(rowMajor.data(), rows, jitted.data()); });
+    double tScalar = timeIt([&] { program.evaluateColumns(columnPointers.data(), rows, scalar.data(), false); });
+    double tSimd = timeIt([&] { program.evaluateColumns(columnPointers.data(), rows, simd.data(), true); });
+    auto perRow = [rows](double ms) { return std::to_string(ms * 1e6 / std::max<size_t>(rows, 1)) + " ns/行"; };
+    std::cout << typeName << ", " << rows << "行:" << std::endl
+        << "\t逐行解释执行\t" << tRow << " ms\t" << perRow(tRow) << std::endl
+        << "\t" << (jit.ok() ? "JIT逐行执行" : "JIT(不支持, 解释执行)") << "\t" << tJit << " ms\t" << perRow(tJit)
+        << (sameResults(jitted, expected) ? "" : "\t结果不一致!") << std::endl
+        << "\t标量块运算\t" << tScalar << " ms\t" << perRow(tScalar) << (sameResults(scalar, expected) ? "" : "\t结果不一致!") << std::endl
+        << "\t" << (cpuHasAVX2() ? "AVX2块运算" : "AVX2块运算(不支持, 标量)") << "\t" << tSimd << " ms\t" << perRow(tSimd)
+        << (sameResults(simd, expected) ? "" : "\t结果不一致!") << std::endl;
+}
+
+// JIT的差分测试: 随机生成count个含变量的表达式, 每个用rows组随机取值分别由JIT和字节码解释执行求值, 返回结果不一致的表达式个数
+template<typename T>
+int differentialTest(OperatorGrammarParser& parser, const PriorityTable& table, int count, size_t rows)
+{
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(-50, 50);
+    int failures = 0;
+    for(int k = 0; k < count; ++k)
+    {
+        std::string formula = generateExpression(1 + rng() % 40, rng(), "abcxyz");
+        Program program;
+        if(!parser.compile(grammar, formula, table, program))
+        {
+            ++failures;
+            continue;
+        }
+        JitExpression<T> jit(program);
+        if(!jit.ok())
+            return -1;
+        const size_t width = program._variables.size();
+        std::vector<T> bindings(rows * width), expected(rows), actual(rows);
+        for(auto& v : bindings)
+            v = (T)dist(rng);
+        program.evaluate(bindings.data(), rows, expected.data());
+        jit.evaluate(bindings.data(), rows, actual.data());
+        if(!sameResults(actual, expected))
+        {
+            if(failures++ < 5)
+                std::cout << "结果不一致: " << formula << std::endl;
+        }
+    }
+    return failures;
+}
+
+// 回归测试: 每个句子分别查优先级表、用优先函数和用Pratt分析, 核对是否接受以及接受时的值, 返回不一致的次数
+// #只能作为结束符, 优先函数给出的#=#不能让分析越过句子末尾
+int regressionTest(OperatorGrammarParser& parser, const PriorityTable& table)
+{
+    struct Case { std::string sentence; bool accept; int value; };
+    const Case cases[] = {
+        {"1+2*3", true, 7}, {"(1+2)*3", true, 9}, {"8/2-1", true, 3}, {"(1+2)*3-4/2#", true, 7},
+        {"", false, 0}, {"#", false, 0}, {"##", false, 0}, {"1##", false, 0}, {"1#2", false, 0},
+        {"1+", false, 0}, {"(1", false, 0}, {"1)", false, 0}, {"12", false, 0},
+    };
+    PrecedenceFunctions functions;
+    bool hasFunctions = parser.constructPrecedenceFunctions(table, functions);
+    EvalContext ctx;
+    int failures = 0;
+    const char* modeNames[] = {" (优先级表)", " (优先函数)", " (Pratt)"};
+    for(auto& c : cases)
+    {
+        for(int mode = 0; mode < (hasFunctions ? 3 : 1); ++mode)
+        {
+            int value = 0;
+            bool ok;
+            if(mode == 2)
+                ok = PrattParser(grammar, table, functions).parse(c.sentence, ctx, value);
+            else
+                ok = parser.operatorGrammarParser(grammar, table, c.sentence, ctx, value, mode ? &functions : nullptr, false);
+            if(ok != c.accept || (ok && value != c.value))
+            {
+                ++failures;
+                std::cout << "回归测试失败: \"" << c.sentence << "\"" << modeNames[mode] << std::endl;
+            }
+        }
+    }
+    return failures;
+}
+
+// 按DAG对变量取值文件逐行求值, 每行依次给出各变量(按DAG的变量顺序)的取值, 每行输出各表达式的值
+template<typename T>
+void evaluateDAGBindings(const ExprDAG& dag, const std::string& bindingsFile, bool useCache)
+{
+    std::fstream fin(bindingsFile, std::ios::in);
+    if(!fin.is_open())
+    {
+        std::cerr << "Error: open file failed!" << std::endl;
+        exit(-1);
+    }
+    const size_t width = dag._variables.size();
+    std::vector<T> row(std::max<size_t>(width, 1)), results(dag._roots.size());
+    DAGEvaluator<T> evaluator(dag, useCache);
+    std::string out;
+    bool more = true;
+    while(more)
+    {
+        for(size_t c = 0; c < width && more; ++c)
+            more = (bool)(fin >> row[c]);
+        if(!more)
+            break;
+        evaluator.evaluate(row.data(), results.data());
+        for(size_t i = 0; i < results.size(); ++i)
+            out += std::to_string(results[i]) + (i + 1 < results.size() ? ' ' : '\n');
+        if(width == 0)
+            break;
+    }
+    std::cout << out;
+}
+
+// 随机生成rows行变量取值(取值范围小, 相当于低基数的列), 比较各表达式分别解释执行与按DAG求值(不用/使用结果缓存)的耗时
+template<typename T>
+void benchmarkDAG(const std::vector<Program>& programs, const ExprDAG& dag, size_t rows, const std::string& typeName)
+{
+    const size_t width = dag._variables.size();
+    std::mt19937 rng(2024);
+    std::uniform_int_distribution<int> dist(-16, 16);
+    std::vector<T> data(rows * width);
+    for(auto& v : data)
+        v = (T)dist(rng);
+    // 每个表达式按自己的变量顺序另存一份, 不计入耗时
+    std::vector<std::vector<T>> programData(programs.size());
+    for(size_t k = 0; k < programs.size(); ++k)
+    {
+        const std::string& vars = programs[k]._variables;
+        programData[k].resize(rows * vars.size());
+        for(size_t r = 0; r < rows; ++r)
+        {
+            for(size_t c = 0; c < vars.size(); ++c)
+                programData[k][r * vars.size() + c] = data[r * width + dag._variables.find(vars[c])];
+        }
+    }
+    const size_t count = programs.size();
+    std::vector<T> expected(rows * count), plain(rows * count), cached(rows * count), column(rows);
+    auto timeIt = [](std::function<void()> f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    double tProgram = timeIt([&] {
+        for(size_t k = 0; k < count; ++k)
+        {
+            programs[k].evaluate(programData[k].data(), rows, column.data());
+            for(size_t r = 0; r < rows; ++r)
+                expected[r * count + k] = column[r];
+        }
+    });
+    DAGEvaluator<T> plainEvaluator(dag, false), cachedEvaluator(dag, true);
+    double tPlain = timeIt([&] {
+        for(size_t r = 0; r < rows; ++r)
+            plainEvaluator.evaluate(data.data() + r * width, plain.data() + r * count);
+    });
+    double tCached = timeIt([&] {
+        for(size_t r = 0; r < rows; ++r)
+            cachedEvaluator.evaluate(data.data() + r * width, cached.data() + r * count);
+    });
+    std::cout << typeName << ", " << rows << "行:" << std::endl
+        << "\t逐个表达式解释执行\t" << tProgram << " ms" << std::endl
+        << "\tDAG求值\t\t" << tPlain << " ms" << (sameResults(plain, expected) ? "" : "\t结果不一致!") << std::endl
+        << "\tDAG求值+结果缓存\t" << tCached << " ms" << (sameResults(cached, expected) ? "" : "\t结果不一致!")
+        << "\t命中" << cachedEvaluator.hits() << "/" << cachedEvaluator.lookups() << std::endl;
+}
+
 void init()
 {
     auto lines = FileRead(ruleFilePath);
@@ -502,28 +1828,251 @@ void init()
     // 结束符号 # 当作终结符加入到终结符集合中
     // 对于单规则而言, 该写法存在bug
     grammar._terminalSymbols.push_back('#');
-    for(auto& p : grammar._productionRules)
-    {
-        if(p._rhs.size() == 1 && grammar.isNonTerminal(p._rhs[0]))
-        {
-            grammar._closure.insert(p._lhs);
-            grammar._closure.insert(p._rhs[0]);
-
-        }
-    }
+    grammar.buildTerminalIndex();
+    grammar.buildHandleTable();
     std::cout << grammar;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+    // -f <ruleFilePath> 指定文法文件, -s <sentence> 指定待分析的句子
+    // -F 由优先级表构造优先函数f/g, 分析时比较函数值而不查优先级表
+    // -c 把句子编译成字节码, 句子中可以有变量; -b <bindingsFile> 对文件中的每一行变量取值求值(隐含-c), -d 取值按double读入
+    // -B <rows> 用随机生成的rows行数据比较逐行解释执行与列式块运算的速度(隐含-c)
+    // -t <threads> 分析完之后再用threads个线程同时反复分析同一个句子
+    // -e <formulasFile> 编译文件中的一批表达式(每行一个)并合并成DAG, 可以与-b/-d/-B一起使用; -C 按DAG求值时使用结果缓存
+    // -J 用-b求值时把表达式编译成x86-64机器码执行; -T <count> 随机生成count个表达式, 比较JIT与解释执行的结果
+    // -P 用优先函数得到的结合力做Pratt分析, 只输出结果; -G <ops> 生成有ops个运算符的句子, 比较移进-规约分析与Pratt分析的速度
+    // -R 用内置的句子做回归测试
+    int threadCount = 0;
+    bool useFunctions = false;
+    bool compileMode = false;
+    bool useDouble = false;
+    size_t benchRows = 0;
+    std::string bindingsFile;
+    std::string formulasFile;
+    bool useCache = false;
+    bool usePratt = false;
+    bool useJit = false;
+    int jitTests = 0;
+    size_t generateOps = 0;
+    bool regression = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if(arg == "-F")
+            useFunctions = true;
+        else if(arg == "-c")
+            compileMode = true;
+        else if(arg == "-t" && i + 1 < argc)
+            threadCount = std::stoi(argv[++i]);
+        else if(arg == "-J")
+            useJit = true;
+        else if(arg == "-T" && i + 1 < argc)
+            jitTests = std::stoi(argv[++i]);
+        else if(arg == "-P")
+            usePratt = true;
+        else if(arg == "-R")
+            regression = true;
+        else if(arg == "-G" && i + 1 < argc)
+            generateOps = std::stoul(argv[++i]);
+        else if(arg == "-C")
+            useCache = true;
+        else if(arg == "-e" && i + 1 < argc)
+            formulasFile = argv[++i];
+        else if(arg == "-d")
+            useDouble = true;
+        else if(arg == "-B" && i + 1 < argc)
+        {
+            compileMode = true;
+            benchRows = std::stoul(argv[++i]);
+        }
+        else if(arg == "-b" && i + 1 < argc)
+        {
+            compileMode = true;
+            bindingsFile = argv[++i];
+        }
+        else if(arg == "-f" && i + 1 < argc)
+            ruleFilePath = argv[++i];
+        else if(arg == "-s" && i + 1 < argc)
+            sentence = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [-f ruleFile] [-s sentence] [-F] [-c] [-b bindingsFile] [-d] [-B rows] [-t threads] [-e formulasFile] [-C] [-P] [-G ops] [-J] [-T count] [-R]" << std::endl;
+            exit(-1);
+        }
+    }
     init();
     OperatorGrammarParser parser;
-    auto firstVT = parser.getAllFirstVT(grammar);
-    parser.printSet(firstVT, "FirstVT");
-    auto lastVT = parser.getAllLastVT(grammar);
-    parser.printSet(lastVT, "LastVT");
-    auto table = parser.constructPriorityTable(grammar);
+    auto firstVT = parser.getVTBits(grammar, false);
+    parser.printSet(parser.toSets(grammar, firstVT), "FirstVT");
+    auto lastVT = parser.getVTBits(grammar, true);
+    parser.printSet(parser.toSets(grammar, lastVT), "LastVT");
+    auto table = parser.constructPriorityTable(grammar, firstVT, lastVT);
     parser.printPriorityTable(table, grammar);
-    parser.operatorGrammarParser(grammar, sentence);
+    if(!formulasFile.empty())
+    {
+        std::vector<Program> programs;
+        ExprDAG dag;
+        for(auto& line : FileRead(formulasFile))
+        {
+            if(line.empty())
+                continue;
+            Program program;
+            if(!parser.compile(grammar, line, table, program))
+                exit(-1);
+            dag.add(program);
+            programs.push_back(program);
+            std::cout << line << "\t" << program << std::endl;
+        }
+        std::cout << "表达式" << programs.size() << "个, 字节码指令共" << dag._instructions << "条, 合并、折叠后DAG结点"
+            << dag._nodes.size() << "个" << std::endl;
+        std::cout << "变量:";
+        for(auto& c : dag._variables)
+            std::cout << " " << c;
+        std::cout << std::endl;
+        if(benchRows)
+        {
+            benchmarkDAG<int>(programs, dag, benchRows, "int");
+            benchmarkDAG<double>(programs, dag, benchRows, "double");
+        }
+        else if(!bindingsFile.empty())
+        {
+            if(useDouble)
+                evaluateDAGBindings<double>(dag, bindingsFile, useCache);
+            else
+                evaluateDAGBindings<int>(dag, bindingsFile, useCache);
+        }
+        return 0;
+    }
+    if(regression)
+    {
+        int failures = regressionTest(parser, table);
+        std::cout << "回归测试: 不一致" << failures << "次" << std::endl;
+        return failures == 0 ? 0 : -1;
+    }
+    if(jitTests)
+    {
+        int intFailures = differentialTest<int>(parser, table, jitTests, 256);
+        int doubleFailures = differentialTest<double>(parser, table, jitTests, 256);
+        if(intFailures < 0 || doubleFailures < 0)
+            std::cout << "JIT不可用" << std::endl;
+        else
+            std::cout << "JIT差分测试: " << jitTests << "个表达式, int不一致" << intFailures << "个, double不一致" << doubleFailures << "个" << std::endl;
+        return intFailures == 0 && doubleFailures == 0 ? 0 : -1;
+    }
+    if(compileMode)
+    {
+        Program program;
+        if(!parser.compile(grammar, sentence, table, program))
+            exit(-1);
+        std::cout << "字节码(逆波兰式): " << program << std::endl;
+        std::cout << "变量:";
+        for(auto& c : program._variables)
+            std::cout << " " << c;
+        std::cout << std::endl;
+        if(benchRows)
+        {
+            benchmark<int>(program, benchRows, "int");
+            benchmark<double>(program, benchRows, "double");
+            return 0;
+        }
+        if(bindingsFile.empty())
+        {
+            if(!program._variables.empty())
+                return 0;
+            int value = 0;
+            program.evaluate<int>(nullptr, 1, &value);
+            std::cout << "表达式的值为: " << value << std::endl;
+            return 0;
+        }
+        if(useDouble)
+            evaluateBindings<double>(program, bindingsFile, useJit);
+        else
+            evaluateBindings<int>(program, bindingsFile, useJit);
+        return 0;
+    }
+    PrecedenceFunctions functions;
+    const PrecedenceFunctions* usedFunctions = nullptr;
+    bool hasFunctions = false;
+    if(useFunctions || usePratt || generateOps)
+    {
+        hasFunctions = parser.constructPrecedenceFunctions(table, functions);
+        if(hasFunctions)
+        {
+            parser.printPrecedenceFunctions(functions, grammar);
+            if(useFunctions)
+                usedFunctions = &functions;
+        }
+        else
+            std::cout << "优先关系图中有环, 优先函数不存在, 改用优先级表" << std::endl;
+    }
+    EvalContext ctx;
+    int value = 0;
+    if(generateOps)
+    {
+        // 在生成的长句子上比较移进-规约分析(不输出过程)与Pratt分析
+        sentence = generateExpression(generateOps, 2024);
+        auto timeIt = [](std::function<bool()> f, bool& ok) {
+            auto start = std::chrono::steady_clock::now();
+            ok = f();
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+        bool ok = false;
+        double t = timeIt([&] { return parser.operatorGrammarParser(grammar, table, sentence, ctx, value, usedFunctions, false); }, ok);
+        std::cout << "生成的句子有" << generateOps << "个运算符, 长" << sentence.size() << std::endl;
+        std::cout << "移进-规约分析\t" << t << " ms\t" << (ok ? "值为" + std::to_string(value) : "出错") << std::endl;
+        if(hasFunctions)
+        {
+            PrattParser pratt(grammar, table, functions);
+            int prattValue = 0;
+            t = timeIt([&] { return pratt.parse(sentence, ctx, prattValue); }, ok);
+            std::cout << "Pratt分析\t" << t << " ms\t" << (ok ? "值为" + std::to_string(prattValue) : "出错") << std::endl;
+        }
+        return 0;
+    }
+    if(usePratt && hasFunctions)
+    {
+        PrattParser pratt(grammar, table, functions);
+        if(!pratt.parse(sentence, ctx, value))
+        {
+            std::cout << "Error: " << sentence << "不是合法的句子!" << std::endl;
+            exit(-1);
+        }
+        if(ctx._noValue)
+            std::cout << "Pratt分析接受: " << sentence << ", 句子中有变量或不能求值的运算符, 没有值" << std::endl;
+        else
+            std::cout << "Pratt分析接受: " << sentence << ", 表达式的值为: " << value << std::endl;
+        return 0;
+    }
+    if(!parser.operatorGrammarParser(grammar, table, sentence, ctx, value, usedFunctions))
+        exit(-1);
+    if(threadCount)
+    {
+        // 各线程共享文法和优先级表, 各用自己的EvalContext反复分析同一个句子, 核对结果都与单线程相同
+        const int rounds = 100000;
+        std::vector<int> mismatches(threadCount, 0);
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for(int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&, t] {
+                EvalContext local;
+                int v = 0;
+                for(int k = 0; k < rounds; ++k)
+                {
+                    if(!parser.operatorGrammarParser(grammar, table, sentence, local, v, usedFunctions, false) || v != value)
+                        ++mismatches[t];
+                }
+            });
+        }
+        for(auto& th : threads)
+            th.join();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        int total = 0;
+        for(auto m : mismatches)
+            total += m;
+        std::cout << threadCount << "个线程各分析" << rounds << "次, 用时" << ms << " ms, 结果不一致" << total << "次" << std::endl;
+    }
     return 0;
 }
\ No newline at end of file
@@ -7,32 +7,34 @@
 #include <stack>
 #include <fstream>
 #include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "../common/FirstFollow.h"
 using namespace std;
 
 /* 产生式结构体，左部符号和右部符号串 */
 struct Production {
     char left;
     vector<char> rigths;
-    /* 重载== */
-    bool operator==(Production& rhs) const {
-        if (left != rhs.left)
-            return false;
-        for (int i = 0; i < rigths.size(); i++) {
-            if (i >= rhs.rigths.size())
-                return false;
-            if (rigths[i] != rhs.rigths[i])
-                return false;
-        }
-        return true;
-    }
 };
 
-/* LR0项目 */
-struct LR0Item {
-    Production p;
-    /* 点的位置 */
-    int location;
-};
+/* LR0项目，压缩成32位：高16位为产生式在grammar.prods中的序号，低16位为点的位置 */
+typedef uint32_t LR0Item;
+const int MAX_ITEM_FIELD = 0xffff;
+
+inline LR0Item makeItem(int prod, int location)
+{
+    return (uint32_t)prod << 16 | (uint32_t)location;
+}
+inline int itemProd(LR0Item t)
+{
+    return t >> 16;
+}
+inline int itemLocation(LR0Item t)
+{
+    return t & 0xffff;
+}
 
 /* LR0项目集 */
 struct LR0Items {
@@ -54,12 +56,28 @@ std::vector<std::string> FileRead(const std::string &filepath)
     return ret;
 }
 
+/* 项目集的核心项目，按压缩后的值排序，即先按产生式序号再按点的位置，核心相同的项目集闭包也相同 */
+typedef vector<LR0Item> Kernel;
+
+struct KernelHash {
+    size_t operator()(const Kernel &k) const
+    {
+        size_t h = k.size();
+        for (int i = 0; i < k.size(); i++) {
+            h = (h ^ k[i]) * 0x9E3779B97F4A7C15ULL;
+        }
+        return h ^ (h >> 29);
+    }
+};
+
 /* LR0项目集规范族 */
 struct CanonicalCollection {
     /* 项目集集合 */
     vector<LR0Items> items;
-    /* 保存DFA的图，first为转移到的状态序号，second是经什么转移 */
-    vector< pair<int, char> > g[100];
+    /* 核心到项目集序号的散列索引 */
+    unordered_map<Kernel, int, KernelHash> index;
+    /* 保存DFA的图，g[i]为状态i的出边，first是经什么转移，second为转移到的状态序号 */
+    vector< vector< pair<char, int> > > g;
 }CC;
 
 /* 文法结构体 */
@@ -74,12 +92,27 @@ struct Grammar {
 map<char, set<char> > first;
 map<char, set<char> > follow;
 
-/* DFA队列， 用于存储待转移的有效项目集 */
-queue< pair<LR0Items, int> > Q;
+/* DFA队列， 存储待转移的有效项目集在CC.items中的序号 */
+queue<int> Q;
 
-/* action表和goto表 */
-pair<int, int> action[100][100]; // first表示分析动作，0->ACC 1->S 2->R second表示转移状态或者产生式序号
-int goton[100][100];
+/* action表和goto表，按状态序号和符号序号稠密存放，大小随项目集规范族的状态数确定 */
+/* action表项编码为32位：高2位表示分析动作 0->出错 1->S 2->R 3->ACC，低30位表示转移状态或者产生式序号 */
+enum { ACT_ERROR = 0, ACT_SHIFT = 1, ACT_REDUCE = 2, ACT_ACC = 3 };
+vector<uint32_t> action;
+vector<int> goton;
+
+inline uint32_t makeAction(int kind, int arg)
+{
+    return (uint32_t)kind << 30 | (uint32_t)arg;
+}
+inline int actionKind(uint32_t a)
+{
+    return a >> 30;
+}
+inline int actionArg(uint32_t a)
+{
+    return a & 0x3fffffff;
+}
 
 /* 待分析串 */
 string str = "(n+n)*n-n/n#";
@@ -106,63 +139,48 @@ int isInN(char ch)
     }
     return 0;
 }
-/* 求(T U N)的FIRST集 */
-void getFirstSet()
+/* 文法符号的稠密编号，终结符在前、非终结符在后，供FirstFollowEngine使用 */
+int symbolId(char ch)
+{
+    int i = isInT(ch);
+    if (i) {
+        return i - 1;
+    }
+    return grammar.T.size() + isInN(ch) - 1;
+}
+/* 求FIRST集和FOLLOW集，不动点由FirstFollowEngine求解，结果转换到first和follow中 */
+void getFirstAndFollowSet()
 {
+    vector<int> lhs;
+    vector< vector<int> > rhs;
+    for (int i = 0; i < grammar.prods.size(); i++) {
+        Production &P = grammar.prods[i];
+        lhs.push_back(symbolId(P.left));
+        vector<int> r;
+        for (int j = 0; j < P.rigths.size(); j++) {
+            /* 空串不参与编码 */
+            if (P.rigths[j] != '&') {
+                r.push_back(symbolId(P.rigths[j]));
+            }
+        }
+        rhs.push_back(r);
+    }
+    FirstFollowEngine engine(grammar.T.size(), grammar.N.size(), lhs, rhs,
+                             symbolId(grammar.N[0]), symbolId('#'));
     /* 终结符的FIRST集是其本身 */
     for (int i = 0; i < grammar.T.size(); i++) {
         char X = grammar.T[i];
-        set<char> tmp;
-        tmp.insert(X);
-        first[X] = tmp;
+        first[X].insert(X);
     }
-    /* 当非终结符的FIRST集发生变化时循环 */
-    bool change = true;
-    while (change) {
-        change = false;
-        /* 枚举每个产生式 */
-        for (int i = 0; i < grammar.prods.size(); i++) {
-            Production &P = grammar.prods[i];
-            char X = P.left;
-            set<char> &FX = first[X];
-            /* 如果右部第一个符号是空或者是终结符，则加入到左部的FIRST集中 */
-            if (isInT(P.rigths[0]) || P.rigths[0] == '&') {
-                /* 查找是否FIRST集是否已经存在该符号 */
-                auto it = FX.find(P.rigths[0]);
-                /* 不存在 */
-                if (it == FX.end()) {
-                    change = true; // 标注FIRST集发生变化，循环继续
-                    FX.insert(P.rigths[0]);
-                }
-            } else {
-                /* 当前符号是非终结符，且当前符号可以推出空，则还需判断下一个符号 */
-                bool next = true;
-                /* 待判断符号的下标 */
-                int idx = 0;
-                while (next && idx < P.rigths.size()) {
-                    next = false;
-                    char Y = P.rigths[idx];
-                    set<char> &FY = first[Y];
-                    for (auto it = FY.begin(); it != FY.end(); it++) {
-                        /* 把当前符号的FIRST集中非空元素加入到左部符号的FIRST集中 */
-                        if (*it != '&') {
-                            auto itt = FX.find(*it);
-                            if (itt == FX.end()) {
-                                change = true;
-                                FX.insert(*it);
-                            }
-                        }
-                    }
-                    /* 当前符号的FIRST集中有空, 标记next为真，idx下标+1 */
-                    auto it = FY.find('&');
-                    if (it != FY.end()) {
-                        next = true;
-                        idx = idx + 1;
-                    }
-                }
-
-            }
+    for (int i = 0; i < grammar.N.size(); i++) {
+        char X = grammar.N[i];
+        int id = symbolId(X);
+        engine.first(id).forEach([&](int t) { first[X].insert(grammar.T[t]); });
+        if (engine.nullable(id)) {
+            first[X].insert('&');
         }
+        follow[X] = set<char>();
+        engine.follow(id).forEach([&](int t) { follow[X].insert(grammar.T[t]); });
     }
 
     printf("FIRST:\n");
@@ -174,104 +192,6 @@ void getFirstSet()
         }
         printf("\n");
     }
-}
-/* 产找alpha串的FIRST集， 保存到FS集合中 */
-void getFirstByAlphaSet(vector<char> &alpha, set<char> &FS)
-{
-    /* 当前符号是非终结符，且当前符号可以推出空，则还需判断下一个符号 */
-    bool next = true;
-    int idx = 0;
-    while (idx < alpha.size() && next) {
-        next = false;
-        /* 当前符号是终结符或空，加入到FIRST集中 */
-        if (isInT(alpha[idx]) || alpha[idx] == '&') {
-            /* 判断是否已经在FIRST集中 */
-            auto itt = FS.find(alpha[idx]);
-            if (itt == FS.end()) {
-                FS.insert(alpha[idx]);
-            }
-        } else {
-            char B = alpha[idx];
-            set<char> &FB = first[B];
-            for (auto it = first[B].begin(); it != first[B].end(); it++) {
-                /* 当前符号FIRST集包含空，标记next为真，并跳过当前循环 */
-                if (*it == '&') {
-                    next = true;
-                    continue;
-                }
-                /* 把非空元素加入到FIRST集中 */
-                auto itt = FS.find(*it);
-                if (itt == FS.end()) {
-                    FS.insert(*it);
-                }
-            }
-        }
-        idx = idx + 1;
-    }
-    /* 如果到达产生式右部末尾next还为真，说明alpha可以推空，将空加入到FIRST集中 */
-    if (next) {
-        FS.insert('&');
-    }
-}
-/* 求非终结符的FOLLOW集 */
-void getFollowSet()
-{
-    /* 初始化终结符的FOLLOW集为空集 */
-    for (int i = 0; i < grammar.N.size(); i++) {
-        char B = grammar.N[i];
-        follow[B] = set<char>();
-    }
-    /* 将$加入到文法的开始符号的FOLLOW集中 */
-    char S = grammar.N[0];
-    follow[S].insert('$');
-
-    bool change = true;
-    while (change) {
-        change = false;
-        /* 枚举每个产生式 */
-        for (int i = 0; i < grammar.prods.size(); i++) {
-            Production &P = grammar.prods[i];
-            for (int j = 0; j < P.rigths.size(); j++) {
-                char B = P.rigths[j];
-                /* 当前符号是非终结符 */
-                if (isInN(B)) {
-                    set<char> &FB = follow[B];
-                    set<char> FS;
-                    /* alpha是从当前符号下一个符号开始的符号串 */
-                    vector<char> alpha(P.rigths.begin() + j + 1, P.rigths.end());
-                    /* 求alpha的FIRST集，即FS */
-                    getFirstByAlphaSet(alpha, FS);
-                    // printf("%c:\n", B);
-                    /* 将alpha的FIRST集中所有非空元素加入到当前符号的FOLLOW集中 */
-                    for (auto it = FS.begin(); it != FS.end(); it++) {
-                        // printf("%c ", *it);
-                        if (*it == '&') {
-                            continue;
-                        }
-                        auto itt = FB.find(*it);
-                        if (itt == FB.end()) {
-                            change = true;
-                            FB.insert(*it);
-                        }
-                    }
-                    // printf("\n");
-                    /* 如果alpha能推空，或者当前符号是产生式右部末尾，则将文法左部符号的FOLLOW集加入到当前符号的FOLLOW集中 */
-                    auto itt = FS.find('&');
-                    if (itt != FS.end() || (j + 1) >= P.rigths.size()) {
-                        char A = P.left;
-                        for (auto it = follow[A].begin(); it != follow[A].end(); it++) {
-                            auto itt = FB.find(*it);
-                            if (itt == FB.end()) {
-                                change = true;
-                                FB.insert(*it);
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-
     printf("FOLLOW:\n");
     for (int i = 0; i < grammar.N.size(); i++) {
         char X = grammar.N[i];
@@ -282,180 +202,130 @@ void getFollowSet()
         printf("\n");
     }
 }
-/* 判断是LR0项目t否在有效项目集I中 */
-bool isInLR0Items(LR0Items &I, LR0Item &t)
-{
-    for (auto it = I.items.begin(); it != I.items.end(); it++) {
-        LR0Item &item = *it;
-        if (item.p == t.p && item.location == t.location)
-            return true;
-    }
-    return false;
-}
-
 /* 打印某个项目集 */
 void printLR0Items(LR0Items &I)
 {
     for (auto it = I.items.begin(); it != I.items.end(); it++) {
-        LR0Item &L = *it;
-        printf("%c->", L.p.left);
-        for (int i = 0; i < L.p.rigths.size(); i++) {
-            if (L.location == i)
+        Production &P = grammar.prods[itemProd(*it)];
+        int location = itemLocation(*it);
+        printf("%c->", P.left);
+        for (int i = 0; i < P.rigths.size(); i++) {
+            if (location == i)
                 printf(".");
-            printf("%c", L.p.rigths[i]);
+            printf("%c", P.rigths[i]);
         }
-        if (L.location == L.p.rigths.size())
+        if (location == P.rigths.size())
             printf(".");
         printf(" ");
     }
     printf("\n");
 }
 
-/* 求I的闭包 */
+/* 求I的闭包，闭包新加入的项目都是点在最左边的项目，按产生式序号标记是否已加入即可判重 */
 void closure(LR0Items &I)
 {
-    bool change =  true;
-    while (change) {
-        change = false;
-        LR0Items J;
-        /* 枚举每个项目 */
-        J.items.assign(I.items.begin(), I.items.end());
-        for (auto it = J.items.begin(); it != J.items.end(); it++) {
-            LR0Item &L = *it;
-            /* 非规约项目 */
-            if (L.location < L.p.rigths.size()) {
-                char B = L.p.rigths[L.location];
-                if (isInN(B)) {
-                    /* 把符合条件的LR0项目加入闭包中 */
-                    for (int i = 0; i < grammar.prods.size(); i++) {
-                        Production &P = grammar.prods[i];
-                        if (P.left == B) {
-                            LR0Item t;
-                            t.location = 0;
-                            t.p.left = P.left;
-                            t.p.rigths.assign(P.rigths.begin(), P.rigths.end());
-                            if (!isInLR0Items(I, t)) {
-                                /* 标记改变 */
-                                change = true;
-                                I.items.push_back(t);
-                            }
-                        }
+    vector<char> added(grammar.prods.size(), 0);
+    for (int k = 0; k < I.items.size(); k++) {
+        if (itemLocation(I.items[k]) == 0) {
+            added[itemProd(I.items[k])] = 1;
+        }
+    }
+    /* 枚举每个项目，新加入的项目排在后面，同样会被枚举到 */
+    for (int k = 0; k < I.items.size(); k++) {
+        Production &L = grammar.prods[itemProd(I.items[k])];
+        int location = itemLocation(I.items[k]);
+        /* 非规约项目 */
+        if (location < L.rigths.size()) {
+            char B = L.rigths[location];
+            if (isInN(B)) {
+                /* 把符合条件的LR0项目加入闭包中 */
+                for (int i = 0; i < grammar.prods.size(); i++) {
+                    if (grammar.prods[i].left == B && !added[i]) {
+                        added[i] = 1;
+                        I.items.push_back(makeItem(i, 0));
                     }
                 }
             }
         }
     }
 }
-/* 判断是否在项目集规范族中，若在返回序号 */
-int isInCanonicalCollection(LR0Items &I)
+/* 取项目集I的核心，go得到的项目集在求闭包之前全部是核心项目 */
+void kernelOf(LR0Items &I, Kernel &K)
 {
-    for (int i = 0; i < CC.items.size(); i++) {
-        LR0Items &J = CC.items[i];
-        bool flag = true;
-        if (J.items.size() != I.items.size()) {
-            flag = false;
-            continue;
-        }
-        /* 每个项目都在该项目集中，则认为这个两个项目集相等 */
-        for (auto it = I.items.begin(); it != I.items.end(); it++) {
-            LR0Item &t = *it;
-            if (!isInLR0Items(J, t)) {
-                flag = false;
-                break;
-            }
-        }
-        if (flag) {
-            return i + 1;
-        }
+    K.assign(I.items.begin(), I.items.end());
+    sort(K.begin(), K.end());
+}
+
+/* 判断核心为K的项目集是否在项目集规范族中，若在返回序号 */
+int isInCanonicalCollection(Kernel &K)
+{
+    auto it = CC.index.find(K);
+    if (it != CC.index.end()) {
+        return it->second + 1;
     }
     return 0;
 }
 
-/* 转移函数，I为当前的项目集，J为转移后的项目集, 经X转移 */
+/* 转移函数，I为当前的项目集，J为转移后的项目集的核心, 经X转移，闭包由调用者在确认是新状态后再求 */
 void go(LR0Items &I, char X, LR0Items &J)
 {
     for (auto it = I.items.begin(); it != I.items.end(); it++) {
-        LR0Item &L = *it;
+        Production &L = grammar.prods[itemProd(*it)];
+        int location = itemLocation(*it);
         /* 非规约项目 */
-        if (L.location < L.p.rigths.size()) {
-            char B = L.p.rigths[L.location];
+        if (location < L.rigths.size()) {
+            char B = L.rigths[location];
             /* 如果点后面是非终结符，且非终结符为X，点位置加1, 加入到转移项目集中*/
             if (B == X) {
-                LR0Item t;
-                t.location = L.location + 1;
-                t.p.left = L.p.left;
-                t.p.rigths.assign(L.p.rigths.begin(), L.p.rigths.end());
-                J.items.push_back(t);
+                J.items.push_back(*it + 1);
             }
         }
     }
-    /* 若J中有项目，则求其闭包 */
-    if (J.items.size() > 0) {
-        closure(J);
+}
+
+/* 转移得到的项目集D若是新状态，求闭包后加入项目集规范族并入队，返回D对应的状态序号 */
+int addState(LR0Items &D, Kernel &K)
+{
+    kernelOf(D, K);
+    int idx = isInCanonicalCollection(K);
+    if (idx > 0) {
+        return idx - 1;
     }
+    idx = CC.items.size();
+    CC.index[K] = idx;
+    closure(D);
+    CC.items.push_back(D);
+    CC.g.push_back(vector< pair<char, int> >());
+    /* 把新加入的有效项目集加入待扩展队列中 */
+    Q.push(idx);
+    return idx;
 }
 
 /* 构建DFA和项目集规范族 */
 void DFA()
 {
     /* 构建初始项目集 */
-    LR0Item t;
-    t.location = 0;
-    t.p.left = grammar.prods[0].left;
-    t.p.rigths.assign(grammar.prods[0].rigths.begin(), grammar.prods[0].rigths.end());
     LR0Items I;
-    I.items.push_back(t);
-    closure(I);
-    /* 加入初始有效项目集 */
-    CC.items.push_back(I);
-    /* 把新加入的有效项目集加入待扩展队列中 */
-    Q.push(pair<LR0Items, int>(I, 0));
+    I.items.push_back(makeItem(0, 0));
+    Kernel K;
+    addState(I, K);
+    LR0Items D;
     while (!Q.empty()) {
-        LR0Items &S = Q.front().first;
-        int sidx = Q.front().second;
-        /* 遍历每个终结符 */
-        for (int i = 0; i  < grammar.T.size(); i++) {
-            LR0Items D;
-            go(S, grammar.T[i], D);
-            int idx;
+        int sidx = Q.front();
+        /* 当前状态出队，CC.items在扩展过程中会增长，每次转移都按序号重新取项目集 */
+        Q.pop();
+        /* 先遍历每个终结符，再遍历每个非终结符 */
+        for (int i = 0; i < grammar.T.size() + grammar.N.size(); i++) {
+            char X = i < grammar.T.size() ? grammar.T[i] : grammar.N[i - grammar.T.size()];
+            D.items.clear();
+            go(CC.items[sidx], X, D);
             /* 若不为空 */
             if (D.items.size() > 0) {
-                /* 查找是否已经在有效项目集族里 */
-                idx = isInCanonicalCollection(D);
-                if (idx > 0) {
-                    idx = idx - 1;
-                } else {
-                    idx = CC.items.size();
-                    CC.items.push_back(D);
-                    /* 把新加入的有效项目集加入待扩展队列中 */
-                    Q.push(pair<LR0Items, int>(D, idx));
-                }
-                /* 从原状态到转移状态加一条边，边上的值为转移符号 */
-                CC.g[sidx].push_back(pair<char, int>(grammar.T[i], idx));
-            }
-        }
-        /* 遍历每个非终结符 */
-        for (int i = 0; i  < grammar.N.size(); i++) {
-            LR0Items D;
-            go(S, grammar.N[i], D);
-            int idx;
-            if (D.items.size() > 0) {
-                /* 查找是否已经在有效项目集族里 */
-                idx = isInCanonicalCollection(D);
-                if (idx != 0) {
-                    idx = idx - 1;
-                } else {
-                    idx = CC.items.size();
-                    CC.items.push_back(D);
-                    /* 把新加入的有效项目集加入待扩展队列中 */
-                    Q.push(pair<LR0Items, int>(D, idx));
-                }
+                int idx = addState(D, K);
                 /* 从原状态到转移状态加一条边，边上的值为转移符号 */
-                CC.g[sidx].push_back(pair<char, int>(grammar.N[i], idx));
+                CC.g[sidx].push_back(pair<char, int>(X, idx));
             }
         }
-    /* 当前状态扩展完毕，移除队列*/
-    Q.pop();
     }
 
     printf("CC size: %d\n", CC.items.size());
@@ -471,14 +341,19 @@ void DFA()
 /* 生成SLR1分析表 */
 void productSLR1AnalysisTabel()
 {
+    int nT = grammar.T.size();
+    int nN = grammar.N.size();
+    action.assign(CC.items.size() * nT, makeAction(ACT_ERROR, 0));
+    goton.assign(CC.items.size() * nN, 0);
     for (int i = 0; i < CC.items.size(); i++) {
         LR0Items &LIt= CC.items[i];
         /* 构建action表 */
         for (auto it = LIt.items.begin(); it != LIt.items.end(); it++) {
-            LR0Item &L = *it;
+            Production &L = grammar.prods[itemProd(*it)];
+            int location = itemLocation(*it);
             /* 非规约项目 */
-            if (L.location < L.p.rigths.size()) {
-                char a = L.p.rigths[L.location];
+            if (location < L.rigths.size()) {
+                char a = L.rigths[location];
                 int j = isInT(a);
                 /* a是终结符 */
                 if (j > 0) {
@@ -487,31 +362,24 @@ void productSLR1AnalysisTabel()
                     for (int k = 0; k < CC.g[i].size(); k++) {
                         pair<char, int> p = CC.g[i][k];
                         if (p.first == a) {
-                            action[i][j].first = 1; // 1->S
-                            action[i][j].second = p.second;  //转移状态
+                            action[i * nT + j] = makeAction(ACT_SHIFT, p.second);  //转移状态
                             break;
                         }
                     }
                 }
             } else { // 规约项目
                 /* 接受项目 */
-                if (L.p.left == grammar.prods[0].left) {
-                    action[i][grammar.T.size() - 1].first = 3;
+                if (L.left == grammar.prods[0].left) {
+                    action[i * nT + nT - 1] = makeAction(ACT_ACC, 0);
                 } else {
-                    char A = L.p.left;
+                    char A = L.left;
                     for (auto a = follow[A].begin(); a != follow[A].end(); a++) {
                         int j = isInT(*a);
                         /* 终结符 */
                         if (j > 0) {
                             j = j - 1;
-                            /* 找到产生式对应的序号 */
-                            for (int k = 0; k < grammar.prods.size(); k++) {
-                                if (L.p == grammar.prods[k]) {
-                                    action[i][j].first = 2;
-                                    action[i][j].second = k;
-                                    break;
-                                }
-                            }
+                            /* 项目中记录的就是产生式的序号 */
+                            action[i * nT + j] = makeAction(ACT_REDUCE, itemProd(*it));
                         }
                     }
                 }
@@ -525,7 +393,7 @@ void productSLR1AnalysisTabel()
             /* 终结符 */
             if (j > 0) {
                 j = j - 1;
-                goton[i][j] = p.second; //转移状态
+                goton[i * nN + j] = p.second; //转移状态
             }
         }
     }
@@ -548,11 +416,12 @@ void productSLR1AnalysisTabel()
     for (int i = 0; i < CC.items.size(); i++) {
         printf("%d\t", i);
         for (int j = 0; j < grammar.T.size(); j++) {
-            if (action[i][j].first == 1) {
-                printf("%c%d\t", 'S', action[i][j].second);
-            } else if (action[i][j].first == 2) {
-                printf("%c%d\t", 'R', action[i][j].second);
-            } else if (action[i][j].first == 3) {
+            uint32_t a = action[i * nT + j];
+            if (actionKind(a) == ACT_SHIFT) {
+                printf("%c%d\t", 'S', actionArg(a));
+            } else if (actionKind(a) == ACT_REDUCE) {
+                printf("%c%d\t", 'R', actionArg(a));
+            } else if (actionKind(a) == ACT_ACC) {
                 printf("ACC\t");
             } else {
                 printf("\t");
@@ -560,8 +429,8 @@ void productSLR1AnalysisTabel()
         }
         printf("|\t");
         for (int j = 1; j < grammar.N.size(); j++) {
-            if (goton[i][j]) {
-                printf("%d\t", goton[i][j]);
+            if (goton[i * nN + j]) {
+                printf("%d\t", goton[i * nN + j]);
             } else {
                 printf("\t");
             }
@@ -603,13 +472,18 @@ void initGrammar()
             for(auto& c : rhs)
                 p.rigths.push_back(c);
             grammar.prods.push_back(p);
+            /* LR0项目中产生式序号和点的位置各占16位 */
+            if(grammar.prods.size() > MAX_ITEM_FIELD || p.rigths.size() >= MAX_ITEM_FIELD)
+            {
+                std::cerr << "Error: grammar is too large!" << std::endl;
+                exit(-1);
+            }
         }
     }
     // 结束符号 # 当作终结符加入到终结符集合中
-    grammar.N.push_back('#');
+    grammar.T.push_back('#');
     /* 求FIRST集和FOLLOW集 */
-    getFirstSet();
-    getFollowSet();
+    getFirstAndFollowSet();
 
     /* 构建DFA和SLR1预测分析表 */
     DFA();
@@ -621,17 +495,21 @@ void initGrammar()
 void process()
 {
     int ip = 0;
+    int nT = grammar.T.size();
+    int nN = grammar.N.size();
     printf("The ans:\n");
     do {
         int s = ST.top().first;
         char a = str[ip];
         int j = isInT(a) - 1;
+        /* 不在终结符表中的符号直接按出错处理 */
+        uint32_t act = j >= 0 ? action[s * nT + j] : makeAction(ACT_ERROR, 0);
         /* 移进 */
-        if (action[s][j].first == 1) {
-            ST.push(pair<int, char>(action[s][j].second, a));
+        if (actionKind(act) == ACT_SHIFT) {
+            ST.push(pair<int, char>(actionArg(act), a));
             ip = ip + 1;
-        } else if (action[s][j].first == 2) { // 规约
-            Production &P = grammar.prods[action[s][j].second];
+        } else if (actionKind(act) == ACT_REDUCE) { // 规约
+            Production &P = grammar.prods[actionArg(act)];
             /* 弹出并输出产生式 */
             printf("%c->", P.left);
             for (int i = 0; i < P.rigths.size(); i++) {
@@ -642,12 +520,13 @@ void process()
             s = ST.top().first;
             char A = P.left;
             j = isInN(A) - 1;
-            ST.push(pair<int, char>(goton[s][j], A));
-        } else if (action[s][j].first == 3) {   //接受
+            ST.push(pair<int, char>(goton[s * nN + j], A));
+        } else if (actionKind(act) == ACT_ACC) {   //接受
             printf("ACC\n");
             return;
         } else {
             printf("error\n");
+            return;
         }
     } while(1);
 }